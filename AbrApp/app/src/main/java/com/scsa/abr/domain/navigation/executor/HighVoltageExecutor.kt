@@ -17,12 +17,21 @@ import kotlin.math.sqrt
 
 private const val TAG = "HighVoltageExecutor"
 
+// Beacon range change accepted as the distance actually driven, relative
+// to the commanded distance
+private const val FEEDBACK_MIN_RATIO = 0.5
+private const val FEEDBACK_MAX_RATIO = 1.5
+
 @Singleton
 class HighVoltageExecutor @Inject constructor(
     private val beaconRepository: BeaconRepository,
     private val bleGattRepository: BleGattRepository
 ) : NavigationExecutor {
 
+    // Last linear move, fed back to the firmware motion model (K:<mm>)
+    // once the next distance measurement is in
+    private var pendingFeedbackMm: Int? = null
+    private var lastMeasuredDistance: Double? = null
 
     override suspend fun executeMove(move: NavigationMove) {
         when (move.direction) {
@@ -34,6 +43,7 @@ class HighVoltageExecutor @Inject constructor(
     }
 
     override suspend fun stop() {
+        pendingFeedbackMm = null
         sendMotorCommand("S")
     }
 
@@ -47,7 +57,32 @@ class HighVoltageExecutor @Inject constructor(
             resultList = getResultList(startTime)
         }
 
-        return getStableDistance(resultList.map { it.distance })
+        val distance = getStableDistance(resultList.map { it.distance })
+        sendMotionFeedback(distance)
+        lastMeasuredDistance = distance
+        return distance
+    }
+
+    // The beacon range only changes by the distance driven when the rover
+    // moved roughly along the line to the beacon, so changes far from the
+    // commanded distance (moving across the line, RSSI noise) are not fed
+    // back to the calibration
+    private suspend fun sendMotionFeedback(distance: Double) {
+        val commandedMm = pendingFeedbackMm ?: return
+        pendingFeedbackMm = null
+        val previous = lastMeasuredDistance ?: return
+
+        val observedMm = (abs(distance - previous) * 1000).roundToInt()
+        if (observedMm < commandedMm * FEEDBACK_MIN_RATIO
+            || observedMm > commandedMm * FEEDBACK_MAX_RATIO
+        ) {
+            Log.i(TAG, "feedback skipped: moved ${observedMm}mm of ${commandedMm}mm")
+            return
+        }
+
+        val command = "K:$observedMm"
+        Log.i(TAG, "feedback: $command")
+        sendMotorCommand(command)
     }
 
     private fun getStableDistance(data: List<Double>): Double {
@@ -103,36 +138,40 @@ class HighVoltageExecutor @Inject constructor(
         return sqrt(variance)
     }
 
+    // Moves are sent in millimetres and degrees; the firmware motion model
+    // converts them to a duration for the current calibration
     private suspend fun moveForward(amount: Int) {
         val forwardSpeedParam = 200
-        val forwardDistParam = 1000 * amount
-        val command = "F:$forwardSpeedParam:$forwardDistParam"
+        val forwardDistMm = 1000 * amount
+        val command = "D:$forwardDistMm:$forwardSpeedParam"
         Log.i(TAG, "moveForward: $command")
         sendMotorCommand(command)
+        pendingFeedbackMm = forwardDistMm
     }
 
     private suspend fun moveBackward(amount: Int) {
         val backwardSpeedParam = 200
-        val backwardDistParam = 1000 * amount
-        val command = "B:$backwardSpeedParam:$backwardDistParam"
+        val backwardDistMm = 1000 * amount
+        val command = "D:-$backwardDistMm:$backwardSpeedParam"
         Log.i(TAG, "moveBackward: $command")
         sendMotorCommand(command)
+        pendingFeedbackMm = backwardDistMm
     }
 
     private suspend fun rotateLeft(amount: Int) {
         val leftSpeedParam = 185
-        val leftTurnParam = 850
-        val command = "G:$leftSpeedParam:${(amount / 90.0 * leftTurnParam).roundToInt()}"
+        val command = "T:-$amount:$leftSpeedParam"
         Log.i(TAG, "rotateLeft: $command")
         sendMotorCommand(command)
+        pendingFeedbackMm = null
     }
 
     private suspend fun rotateRight(amount: Int) {
         val rightSpeedParam = 185
-        val rightTurnParam = 850
-        val command = "H:$rightSpeedParam:${(amount / 90.0 * rightTurnParam).roundToInt()}"
+        val command = "T:$amount:$rightSpeedParam"
         Log.i(TAG, "rotateRight: $command")
         sendMotorCommand(command)
+        pendingFeedbackMm = null
     }
 
     private suspend fun sendMotorCommand(command: String) {
@@ -1,20 +1,128 @@
 #include "motor_control.h"
 #include "command_interface.h"
 #include "ble_manager.h"
+#include "power_manager.h"
+#include "metrics.h"
+#include "motion_model.h"
+#include "position_estimator.h"
+#include "session_capture.h"
+#include "session_replay.h"
+#include "bulk_transfer.h"
+#include "flight_recorder.h"
+#include "obstacle_sensor.h"
 
 // Create instances
 MotorControl motors;
-CommandInterface commands(&motors);
+MotionModel motion;
+PositionEstimator position;
+CommandInterface commands(&motors, &motion);
 BLEManager bleManager(&commands);
+PowerManager power(&motors, &bleManager);
+SessionReplay replay(&motors, &motion, &commands, &bleManager);
+BulkTransfer bulk(&bleManager, &motors);
+ObstacleSensor obstacles(&motion);
 
 // Safety timeout - stop motors if no command received
 #define COMMAND_TIMEOUT_MS  10000
 unsigned long lastCommandTime = 0;
 bool timeoutEnabled = true;
 
+// Loop period measurement
+unsigned long lastLoopMicros = 0;
+
+// Longest accepted idle timeout
+#define MAX_IDLE_TIMEOUT_S  86400
+
+// Parse a whole number of seconds, -1 if not a number or out of range
+long parseSeconds(const String& value) {
+  if (value.length() == 0 || value.length() > 5) return -1;
+  for (unsigned int i = 0; i < value.length(); i++) {
+    if (!isDigit(value.charAt(i))) return -1;
+  }
+  long seconds = value.toInt();
+  return (seconds <= MAX_IDLE_TIMEOUT_S) ? seconds : -1;
+}
+
 // Callback function to update command timestamp
 void onCommandReceived() {
   lastCommandTime = millis();
+  power.notifyActivity(lastCommandTime);
+}
+
+// Callback function to provide power telemetry for BLE status
+String getPowerTelemetry() {
+  return power.getTelemetry();
+}
+
+// Forward guard: stop short of obstacles at the commanded duty
+bool obstacleGuard(uint8_t duty) {
+  return obstacles.isClear(duty);
+}
+
+// Callback function to forward obstacle events to the status stream
+void onObstacleEvent(const String& event) {
+  bleManager.sendStatus(event);
+}
+
+// Callback function holding the motors while firmware is written
+bool motionAllowed() {
+  return !bulk.isUpdating();
+}
+
+// Callback function to route bulk channel frames
+void onBulkReceived(const uint8_t* data, size_t length) {
+  bulk.onReceive(data, length);
+}
+
+// Bulk stream sources
+size_t captureSize() {
+  return capture.byteSize();
+}
+
+size_t captureRead(uint32_t offset, uint8_t* buffer, size_t length) {
+  return capture.readBytes(offset, buffer, length);
+}
+
+// Metrics snapshot frozen when a bulk download opens
+uint8_t metricsSnapshot[METRICS_SNAPSHOT_MAX];
+size_t metricsSnapshotLength = 0;
+
+size_t metricsSize() {
+  metricsSnapshotLength = metrics.snapshot(metricsSnapshot, sizeof(metricsSnapshot));
+  return metricsSnapshotLength;
+}
+
+size_t metricsRead(uint32_t offset, uint8_t* buffer, size_t length) {
+  if (offset >= metricsSnapshotLength) return 0;
+  length = min(length, (size_t)(metricsSnapshotLength - offset));
+  memcpy(buffer, metricsSnapshot + offset, length);
+  return length;
+}
+
+size_t flightSize() {
+  return flight.byteSize();
+}
+
+size_t flightRead(uint32_t offset, uint8_t* buffer, size_t length) {
+  return flight.readBytes(offset, buffer, length);
+}
+
+// Print a query response: text as-is, binary as hex
+void printResponse() {
+  if (!commands.hasResponse()) return;
+
+  const uint8_t* data = commands.getResponse();
+  size_t length = commands.getResponseLength();
+  if (data[0] == METRICS_MAGIC) {
+    for (size_t i = 0; i < length; i++) {
+      Serial.printf("%02X", data[i]);
+    }
+    Serial.println();
+  } else {
+    Serial.write(data, length);
+    Serial.println();
+  }
+  commands.clearResponse();
 }
 
 void setup() {
@@ -26,17 +134,45 @@ void setup() {
   Serial.println("[MAIN] (BLE + Serial Control Mode)");
   Serial.println();
 
+  // Preserve the flight record of a crashed run before anything
+  // writes to it
+  flight.begin();
+
   // Initialize motor control
   motors.begin();
+  motors.setOutputObserver(SessionCapture::recordOutput);
+
+  // Load motion calibration; captures save it for replay
+  motion.begin();
+  capture.setMotionModel(&motion);
 
   // Initialize command interface
   commands.begin();
+  commands.setPositionEstimator(&position);
 
   // Initialize BLE
   bleManager.begin();
 
   // Register callback for BLE commands
   bleManager.setCommandReceivedCallback(onCommandReceived);
+  bleManager.setTelemetryCallback(getPowerTelemetry);
+  bleManager.setBulkReceiver(onBulkReceived);
+
+  // Initialize bulk transfer channel
+  bulk.begin();
+  bulk.registerSource({BULK_STREAM_CAPTURE, captureSize, captureRead});
+  bulk.registerSource({BULK_STREAM_FLIGHT, flightSize, flightRead});
+  bulk.registerSource({BULK_STREAM_METRICS, metricsSize, metricsRead});
+  motors.setMotionGuard(motionAllowed);
+
+  // Initialize obstacle sensing and gate forward motion on it
+  obstacles.addSensor(ULTRASONIC_TRIG_PIN, ULTRASONIC_ECHO_PIN);
+  obstacles.begin();
+  obstacles.setEventCallback(onObstacleEvent);
+  motors.setForwardGuard(obstacleGuard);
+
+  // Initialize idle power management
+  power.begin(millis());
 
   Serial.println();
   Serial.println("System ready!");
@@ -46,25 +182,40 @@ void setup() {
 }
 
 void loop() {
+  unsigned long loopMicros = micros();
+  if (lastLoopMicros != 0) {
+    metrics.record(HIST_LOOP_PERIOD_US, loopMicros - lastLoopMicros);
+  }
+  lastLoopMicros = loopMicros;
+
   // Update BLE connection state
   bleManager.update();
+
+  // Range obstacles and stop a forward move that can no longer stop
+  // in time, before timed moves are serviced
+  obstacles.update(millis());
+  motors.checkForwardGuard();
+
   commands.update();
 
   // Safety timeout - stop if no commands received
   if (timeoutEnabled && motors.isMoving()) {
     if (millis() - lastCommandTime > COMMAND_TIMEOUT_MS) {
       Serial.println("[Safety] Command timeout - stopping motors");
+      capture.recordEvent(CAPTURE_CAUSE_TIMEOUT);
       motors.stop();
     }
   }
 
   // Read commands from Serial
+  metrics.set(GAUGE_SERIAL_QUEUE, Serial.available());
   if (Serial.available()) {
     String input = Serial.readStringUntil('\n');
     input.trim();
 
     if (input.length() > 0) {
       lastCommandTime = millis();
+      power.notifyActivity(lastCommandTime);
 
       // Echo input
       Serial.print("> ");
@@ -79,13 +230,102 @@ void loop() {
         timeoutEnabled = true;
         Serial.println("[Config] Timeout enabled");
       }
+      else if (input.equalsIgnoreCase("idle off")) {
+        power.setIdleTimeout(0);
+        Serial.println("[Config] Idle mode disabled");
+      }
+      else if (input.substring(0, 5).equalsIgnoreCase("idle ")) {
+        // idle <seconds> - stopped time before entering idle mode
+        String value = input.substring(5);
+        value.trim();
+        long seconds = parseSeconds(value);
+        if (seconds < 0) {
+          Serial.printf("[Config] ERROR: idle expects 0-%d seconds or 'off'\n", MAX_IDLE_TIMEOUT_S);
+        } else {
+          power.setIdleTimeout(seconds * 1000UL);
+          Serial.printf("[Config] Idle after %lds stopped\n", seconds);
+        }
+      }
+      else if (input.equalsIgnoreCase("power")) {
+        Serial.println(power.getTelemetry());
+      }
+      else if (input.equalsIgnoreCase("metrics")) {
+        metrics.print();
+      }
+      else if (input.equalsIgnoreCase("calib")) {
+        motion.print();
+      }
+      else if (input.equalsIgnoreCase("calib reset")) {
+        motion.resetCalibration();
+        Serial.println("[Config] Motion calibration reset");
+      }
+      else if (input.equalsIgnoreCase("capture start")) {
+        capture.start();
+      }
+      else if (input.equalsIgnoreCase("capture stop")) {
+        capture.stop();
+      }
+      else if (input.equalsIgnoreCase("capture dump")) {
+        capture.dump();
+      }
+      else if (input.equalsIgnoreCase("capture clear")) {
+        capture.clear();
+        Serial.println("[Capture] Cleared");
+      }
+      else if (input.startsWith(CAPTURE_LINE_PREFIX)) {
+        // Load a previously dumped capture line by line
+        if (!capture.isRecording() && capture.load(input)) {
+          Serial.printf("[Capture] Loaded record %d\n", (int)capture.count());
+        } else {
+          Serial.println("[Capture] ERROR: Cannot load record");
+        }
+      }
+      else if (input.equalsIgnoreCase("obstacle")) {
+        obstacles.print();
+      }
+      else if (input.equalsIgnoreCase("flight")) {
+        flight.print();
+      }
+      else if (input.equalsIgnoreCase("flight dump")) {
+        flight.dump();
+      }
+      else if (input.equalsIgnoreCase("replay")) {
+        if (capture.isRecording()) capture.stop();
+        replay.run(capture);
+      }
       else {
         // Process motor command
+        metrics.increment(CTR_SERIAL_COMMANDS);
+        metrics.markCommandStart();
+        capture.recordInput(CAPTURE_SERIAL_INPUT, (const uint8_t*)input.c_str(), input.length());
+        commands.lock();
         commands.process(input);
+        printResponse();
+        commands.unlock();
       }
     }
   }
 
-  // Small delay to prevent watchdog issues
-  delay(10);
+  // Persist settled motion calibration
+  motion.update(millis());
+
+  // Sample heap and stack gauges
+  metrics.sampleSystem(millis());
+
+  // Sample supply voltage into the flight recorder
+  flight.update(millis());
+
+  // Stream bulk blocks and flush OTA writes; keep the fast tick
+  // while a transfer is running
+  bulk.update(millis());
+  if (bulk.isActive()) {
+    power.notifyActivity(millis());
+  }
+
+  // Update idle power state
+  power.update(millis());
+
+  // Yield until the next control tick; longer while idle so the
+  // chip can drop into automatic light sleep
+  delay(power.getTickInterval());
 }
@@ -1,150 +1,338 @@
-/*
- * ble_manager.cpp
- * BLE connection manager implementation
- */
-
-#include "ble_manager.h"
-
-BLEManager::BLEManager(CommandInterface* commands)
-  : commands(commands),
-    pServer(nullptr),
-    pControlCharacteristic(nullptr),
-    pStatusCharacteristic(nullptr),
-    deviceConnected(false),
-    oldDeviceConnected(false),
-    lastStatusUpdate(0),
-    commandReceivedCallback(nullptr) {
-}
-
-void BLEManager::begin() {
-  Serial.println("[BLE] Initializing...");
-
-  // Initialize BLE Device
-  BLEDevice::init(BLE_DEVICE_NAME);
-
-  // Create BLE Server
-  pServer = BLEDevice::createServer();
-  pServer->setCallbacks(this);
-
-  // Create BLE Service
-  BLEService* pService = pServer->createService(SERVICE_UUID);
-
-  // Create Control Characteristic (Write)
-  // This receives commands from the Android app
-  pControlCharacteristic = pService->createCharacteristic(
-    CONTROL_CHAR_UUID,
-    BLECharacteristic::PROPERTY_WRITE |
-    BLECharacteristic::PROPERTY_WRITE_NR
-  );
-  pControlCharacteristic->setCallbacks(this);
-
-  // Create Status Characteristic (Read + Notify)
-  // This sends status updates to the Android app
-  pStatusCharacteristic = pService->createCharacteristic(
-    STATUS_CHAR_UUID,
-    BLECharacteristic::PROPERTY_READ |
-    BLECharacteristic::PROPERTY_NOTIFY
-  );
-  pStatusCharacteristic->addDescriptor(new BLE2902());
-
-  // Start the service
-  pService->start();
-
-  // Start advertising
-  BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
-  pAdvertising->addServiceUUID(SERVICE_UUID);
-  pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06);
-  pAdvertising->setMaxPreferred(0x12);
-  BLEDevice::startAdvertising();
-
-  Serial.println("[BLE] Service started");
-  Serial.print("[BLE] Device name: ");
-  Serial.println(BLE_DEVICE_NAME);
-  Serial.println("[BLE] Waiting for connection...");
-}
-
-void BLEManager::update() {
-  // Handle connection state changes
-  if (!deviceConnected && oldDeviceConnected) {
-    // Disconnected - restart advertising
-    delay(500);
-    pServer->startAdvertising();
-    Serial.println("[BLE] Disconnected. Advertising restarted.");
-    oldDeviceConnected = deviceConnected;
-  }
-
-  if (deviceConnected && !oldDeviceConnected) {
-    // Connected
-    oldDeviceConnected = deviceConnected;
-    Serial.println("[BLE] Connected!");
-  }
-
-  // Send periodic status updates
-  if (deviceConnected) {
-    unsigned long now = millis();
-    if (now - lastStatusUpdate > STATUS_UPDATE_INTERVAL) {
-      String status = commands->getStatus();
-      sendStatus(status);
-      lastStatusUpdate = now;
-    }
-  }
-}
-
-bool BLEManager::isConnected() const {
-  return deviceConnected;
-}
-
-void BLEManager::setCommandReceivedCallback(void (*callback)()) {
-  commandReceivedCallback = callback;
-}
-
-void BLEManager::sendStatus(const String& status) {
-  if (deviceConnected && pStatusCharacteristic) {
-    pStatusCharacteristic->setValue(status);
-    pStatusCharacteristic->notify();
-  }
-}
-
-// BLE Server Callbacks
-void BLEManager::onConnect(BLEServer* pServer) {
-  deviceConnected = true;
-  Serial.println("[BLE] Client connected");
-}
-
-void BLEManager::onDisconnect(BLEServer* pServer) {
-  deviceConnected = false;
-  Serial.println("[BLE] Client disconnected");
-}
-
-// BLE Characteristic Callbacks
-void BLEManager::onWrite(BLECharacteristic* pCharacteristic) {
-  // Called when Android app writes to control characteristic
-  Serial.println("[BLE] onWrite");
-  if (pCharacteristic == pControlCharacteristic) {
-    String value = pCharacteristic->getValue();
-
-    // Validate command
-    if (value.length() > 0 && value.length() <= 64) {
-      // Valid command received - notify callback BEFORE processing
-      Serial.println("[BLE] onWrite->validateCommand");
-      if (commandReceivedCallback != nullptr) {
-        commandReceivedCallback();
-      }
-
-      // Process the command
-      processCommand(value);
-    } else if (value.length() > 64) {
-      Serial.printf("[BLE] ERROR: Command too long (%d bytes, max 64)\n", value.length());
-    }
-  }
-}
-
-void BLEManager::processCommand(const String& cmd) {
-  // Echo command for debugging
-  Serial.print("[BLE] Received: ");
-  Serial.println(cmd);
-
-  // Process through command interface
-  commands->process(cmd);
-}
+/*
+ * ble_manager.cpp
+ * BLE connection manager implementation
+ */
+
+#include "ble_manager.h"
+#include "metrics.h"
+#include "session_capture.h"
+
+// Bulk characteristics need an authenticated (MITM) bond when a passkey
+// is configured, otherwise just an encrypted one
+#if BLE_PASSKEY
+#define BULK_PERM_READ      ESP_GATT_PERM_READ_ENC_MITM
+#define BULK_PERM_WRITE     ESP_GATT_PERM_WRITE_ENC_MITM
+#else
+#define BULK_PERM_READ      ESP_GATT_PERM_READ_ENCRYPTED
+#define BULK_PERM_WRITE     ESP_GATT_PERM_WRITE_ENCRYPTED
+#endif
+
+BLEManager::BLEManager(CommandInterface* commands)
+  : commands(commands),
+    pServer(nullptr),
+    pControlCharacteristic(nullptr),
+    pStatusCharacteristic(nullptr),
+    pBulkRxCharacteristic(nullptr),
+    pBulkTxCharacteristic(nullptr),
+    deviceConnected(false),
+    oldDeviceConnected(false),
+    remoteAddress{0},
+    connectionId(0),
+    lowPowerMode(false),
+    replayActive(false),
+    lastStatusUpdate(0),
+    commandReceivedCallback(nullptr),
+    telemetryCallback(nullptr),
+    bulkReceiver(nullptr) {
+}
+
+void BLEManager::begin() {
+  Serial.println("[BLE] Initializing...");
+
+  // Initialize BLE Device
+  BLEDevice::init(BLE_DEVICE_NAME);
+  BLEDevice::setMTU(BLE_MAX_MTU);
+
+  // Create BLE Server
+  pServer = BLEDevice::createServer();
+  pServer->setCallbacks(this);
+
+  // Create BLE Service
+  BLEService* pService = pServer->createService(SERVICE_UUID);
+
+  // Create Control Characteristic (Write)
+  // This receives commands from the Android app
+  pControlCharacteristic = pService->createCharacteristic(
+    CONTROL_CHAR_UUID,
+    BLECharacteristic::PROPERTY_WRITE |
+    BLECharacteristic::PROPERTY_WRITE_NR
+  );
+  pControlCharacteristic->setCallbacks(this);
+
+  // Create Status Characteristic (Read + Notify)
+  // This sends status updates to the Android app
+  pStatusCharacteristic = pService->createCharacteristic(
+    STATUS_CHAR_UUID,
+    BLECharacteristic::PROPERTY_READ |
+    BLECharacteristic::PROPERTY_NOTIFY
+  );
+  pStatusCharacteristic->addDescriptor(new BLE2902());
+
+  // Create Bulk Characteristics (Write without response / Notify)
+  // MTU-sized frames for log/capture download and OTA upload. Both need
+  // a bonded link, authenticated with BLE_PASSKEY if one is set; the
+  // stack starts pairing on first access
+  pBulkRxCharacteristic = pService->createCharacteristic(
+    BULK_RX_CHAR_UUID,
+    BLECharacteristic::PROPERTY_WRITE_NR
+  );
+  pBulkRxCharacteristic->setAccessPermissions(BULK_PERM_WRITE);
+  pBulkRxCharacteristic->setCallbacks(this);
+
+  pBulkTxCharacteristic = pService->createCharacteristic(
+    BULK_TX_CHAR_UUID,
+    BLECharacteristic::PROPERTY_NOTIFY
+  );
+  pBulkTxCharacteristic->setAccessPermissions(BULK_PERM_READ);
+  BLE2902* bulkNotify = new BLE2902();
+  bulkNotify->setAccessPermissions(BULK_PERM_READ | BULK_PERM_WRITE);
+  pBulkTxCharacteristic->addDescriptor(bulkNotify);
+
+  // Secure Connections bonding. The rover has no display or keypad, so
+  // the passkey is a fixed one the owner enters on the phone; without it
+  // pairing is Just Works and any phone in range can bond
+  BLESecurity* pSecurity = new BLESecurity();
+#if BLE_PASSKEY
+  pSecurity->setStaticPIN(BLE_PASSKEY);
+  pSecurity->setCapability(ESP_IO_CAP_OUT);
+  pSecurity->setAuthenticationMode(ESP_LE_AUTH_REQ_SC_MITM_BOND);
+#else
+  pSecurity->setAuthenticationMode(ESP_LE_AUTH_REQ_SC_BOND);
+  pSecurity->setCapability(ESP_IO_CAP_NONE);
+  Serial.println("[BLE] WARNING: BLE_PASSKEY not set, pairing unauthenticated and OTA upload off");
+#endif
+  pSecurity->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+  pSecurity->setRespEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+
+  // Start the service
+  pService->start();
+
+  // Start advertising
+  BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
+  pAdvertising->addServiceUUID(SERVICE_UUID);
+  pAdvertising->setScanResponse(true);
+  pAdvertising->setMinPreferred(BLE_ACTIVE_MIN_INTERVAL);
+  pAdvertising->setMaxPreferred(BLE_ACTIVE_MAX_INTERVAL);
+  BLEDevice::startAdvertising();
+
+  Serial.println("[BLE] Service started");
+  Serial.print("[BLE] Device name: ");
+  Serial.println(BLE_DEVICE_NAME);
+  Serial.println("[BLE] Waiting for connection...");
+}
+
+void BLEManager::update() {
+  // Handle connection state changes
+  if (!deviceConnected && oldDeviceConnected) {
+    // Disconnected - restart advertising
+    delay(500);
+    pServer->startAdvertising();
+    Serial.println("[BLE] Disconnected. Advertising restarted.");
+    oldDeviceConnected = deviceConnected;
+  }
+
+  if (deviceConnected && !oldDeviceConnected) {
+    // Connected
+    oldDeviceConnected = deviceConnected;
+    Serial.println("[BLE] Connected!");
+  }
+
+  // Send periodic status updates
+  if (deviceConnected) {
+    unsigned long now = millis();
+    if (now - lastStatusUpdate > STATUS_UPDATE_INTERVAL) {
+      String status = commands->getStatus();
+      sendStatus(status);
+      if (telemetryCallback != nullptr) {
+        sendStatus(telemetryCallback());
+      }
+      lastStatusUpdate = now;
+    }
+  }
+}
+
+bool BLEManager::isConnected() const {
+  return deviceConnected;
+}
+
+void BLEManager::setCommandReceivedCallback(void (*callback)()) {
+  commandReceivedCallback = callback;
+}
+
+void BLEManager::setTelemetryCallback(String (*callback)()) {
+  telemetryCallback = callback;
+}
+
+void BLEManager::setBulkReceiver(void (*receiver)(const uint8_t* data, size_t length)) {
+  bulkReceiver = receiver;
+}
+
+bool BLEManager::sendBulk(const uint8_t* data, size_t length) {
+  if (!deviceConnected || pBulkTxCharacteristic == nullptr) return false;
+
+  pBulkTxCharacteristic->setValue((uint8_t*)data, length);
+  pBulkTxCharacteristic->notify();
+  return true;
+}
+
+uint16_t BLEManager::getMtu() const {
+  if (!deviceConnected || pServer == nullptr) return 23;
+  return pServer->getPeerMTU(connectionId);
+}
+
+void BLEManager::setLowPowerMode(bool enabled) {
+  if (lowPowerMode == enabled) return;
+  lowPowerMode = enabled;
+  applyConnectionParams();
+}
+
+void BLEManager::setReplayActive(bool active) {
+  replayActive = active;
+}
+
+void BLEManager::applyConnectionParams() {
+  if (!deviceConnected || pServer == nullptr) return;
+
+  // The central makes the final decision; this is only a request
+  if (lowPowerMode) {
+    pServer->updateConnParams(remoteAddress, BLE_IDLE_MIN_INTERVAL,
+                              BLE_IDLE_MAX_INTERVAL, 0, BLE_SUPERVISION_TIMEOUT);
+    Serial.println("[BLE] Requested idle connection interval");
+  } else {
+    pServer->updateConnParams(remoteAddress, BLE_ACTIVE_MIN_INTERVAL,
+                              BLE_ACTIVE_MAX_INTERVAL, 0, BLE_SUPERVISION_TIMEOUT);
+    Serial.println("[BLE] Requested active connection interval");
+  }
+}
+
+void BLEManager::sendStatus(const String& status) {
+  if (deviceConnected && pStatusCharacteristic) {
+    pStatusCharacteristic->setValue(status);
+    pStatusCharacteristic->notify();
+  }
+}
+
+// BLE Server Callbacks
+void BLEManager::onConnect(BLEServer* /*pServer*/) {
+  deviceConnected = true;
+  Serial.println("[BLE] Client connected");
+}
+
+void BLEManager::onConnect(BLEServer* /*pServer*/, esp_ble_gatts_cb_param_t* param) {
+  // Remember the peer so connection parameters can be renegotiated later
+  memcpy(remoteAddress, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+  connectionId = param->connect.conn_id;
+  if (lowPowerMode) {
+    applyConnectionParams();
+  }
+}
+
+void BLEManager::onDisconnect(BLEServer* /*pServer*/) {
+  deviceConnected = false;
+  Serial.println("[BLE] Client disconnected");
+}
+
+// BLE Characteristic Callbacks
+void BLEManager::onWrite(BLECharacteristic* pCharacteristic) {
+  // Called when Android app writes to control characteristic
+  if (pCharacteristic == pControlCharacteristic) {
+    metrics.setBleTask(xTaskGetCurrentTaskHandle());
+    metrics.markCommandStart();
+    Serial.println("[BLE] onWrite");
+
+    // Raw bytes: commands may be text or binary (see command_interface.h)
+    handleControlWrite(pCharacteristic->getData(), pCharacteristic->getLength());
+  } else if (pCharacteristic == pBulkRxCharacteristic) {
+    // Bulk frames are not logged: they arrive at up to one per interval
+    if (bulkReceiver != nullptr) {
+      bulkReceiver(pCharacteristic->getData(), pCharacteristic->getLength());
+    }
+  }
+
+  // Nothing was actuated by a rejected write
+  metrics.clearCommandStart();
+}
+
+void BLEManager::handleControlWrite(const uint8_t* data, size_t length) {
+  if (replayActive) {
+    // The command interface is running a dry-run replay on the loop
+    // task; refuse the write so the app can resend it afterwards
+    metrics.increment(CTR_BLE_ERRORS);
+    Serial.println("[BLE] Busy replaying, command refused");
+    sendStatus("BUSY:REPLAY");
+    return;
+  }
+
+  receiveControlWrite(data, length);
+}
+
+void BLEManager::replayControlWrite(const uint8_t* data, size_t length) {
+  receiveControlWrite(data, length);
+}
+
+void BLEManager::receiveControlWrite(const uint8_t* data, size_t length) {
+  // While a replay runs only replayed writes get here; they leave the
+  // live metrics, app callback and connected phone alone
+  bool live = !replayActive;
+
+  capture.recordInput(CAPTURE_BLE_WRITE, data, length);
+  if (live) metrics.increment(CTR_BLE_WRITES);
+
+  // Validate command
+  if (length > 0 && length <= COMMAND_MAX_LENGTH) {
+    // Valid command received - notify callback BEFORE processing
+    Serial.println("[BLE] onWrite->validateCommand");
+    if (live && commandReceivedCallback != nullptr) {
+      commandReceivedCallback();
+    }
+
+    // Process the command
+    processCommand(data, length);
+  } else if (length > COMMAND_MAX_LENGTH) {
+    if (live) metrics.increment(CTR_BLE_ERRORS);
+    Serial.printf("[BLE] ERROR: Command too long (%d bytes, max %d)\n",
+                  (int)length, COMMAND_MAX_LENGTH);
+  }
+}
+
+void BLEManager::processCommand(const uint8_t* data, size_t length) {
+  // Echo command for debugging
+  if (data[0] & BINARY_OPCODE_FLAG) {
+    Serial.printf("[BLE] Received binary opcode '%c' (%d bytes)\n",
+                  data[0] & ~BINARY_OPCODE_FLAG, (int)length);
+  } else {
+    Serial.print("[BLE] Received: ");
+    Serial.write(data, length);
+    Serial.println();
+  }
+
+  // Process through command interface; a replayed write is not a live
+  // command and stays out of the command metrics
+  if (replayActive) {
+    commands->execute(commands->parse(data, length));
+    commands->clearResponse();
+    return;
+  }
+
+  // Keep the response ours until it is sent: the loop task may run a
+  // serial command meanwhile
+  commands->lock();
+  commands->process(data, length);
+
+  // Query responses go back on the status characteristic. The metrics
+  // snapshot does not fit one notification at the default MTU and the
+  // periodic status update would overwrite it, so it is announced here
+  // and fetched from the bulk channel instead.
+  if (commands->hasResponse() && pStatusCharacteristic) {
+    const uint8_t* response = commands->getResponse();
+    size_t responseLength = commands->getResponseLength();
+    if (response[0] == METRICS_MAGIC && responseLength > (size_t)getMtu() - 3) {
+      sendStatus("METRICS:BULK:" + String((unsigned int)responseLength));
+    } else {
+      pStatusCharacteristic->setValue((uint8_t*)response, responseLength);
+      pStatusCharacteristic->notify();
+    }
+    commands->clearResponse();
+  }
+  commands->unlock();
+}
@@ -1,63 +1,119 @@
-/*
- * ble_manager.h
- * BLE connection manager for ESP32-C6
- * Handles Bluetooth Low Energy communication with Android app
- */
-
-#ifndef BLE_MANAGER_H
-#define BLE_MANAGER_H
-
-#include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
-#include "command_interface.h"
-
-// BLE UUIDs
-#define SERVICE_UUID        "3fd350f5-1c0c-4d79-847c-91877824399e"
-#define CONTROL_CHAR_UUID   "253a357f-39cb-4989-8bdf-f6b5ae8b7c65"
-#define STATUS_CHAR_UUID    "b876fdc9-618d-4ea1-a83f-7e07cc89f963"
-
-// BLE device name
-#define BLE_DEVICE_NAME     "AndroidBeaconRover"
-
-class BLEManager : public BLEServerCallbacks, public BLECharacteristicCallbacks {
-public:
-  BLEManager(CommandInterface* commands);
-
-  void begin();
-  void update();
-
-  bool isConnected() const;
-  void sendStatus(const String& status);
-
-  // Set callback for when valid command is received
-  void setCommandReceivedCallback(void (*callback)());
-
-  // BLEServerCallbacks
-  void onConnect(BLEServer* pServer) override;
-  void onDisconnect(BLEServer* pServer) override;
-
-  // BLECharacteristicCallbacks
-  void onWrite(BLECharacteristic* pCharacteristic) override;
-
-private:
-  CommandInterface* commands;
-  BLEServer* pServer;
-  BLECharacteristic* pControlCharacteristic;
-  BLECharacteristic* pStatusCharacteristic;
-
-  bool deviceConnected;
-  bool oldDeviceConnected;
-
-  unsigned long lastStatusUpdate;
-  const unsigned long STATUS_UPDATE_INTERVAL = 1000; // 1 second
-
-  // Callback function pointer
-  void (*commandReceivedCallback)();
-
-  void processCommand(const String& cmd);
-};
-
-#endif // BLE_MANAGER_H
+/*
+ * ble_manager.h
+ * BLE connection manager for ESP32-C6
+ * Handles Bluetooth Low Energy communication with Android app
+ */
+
+#ifndef BLE_MANAGER_H
+#define BLE_MANAGER_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLEUtils.h>
+#include <BLE2902.h>
+#include <BLESecurity.h>
+#include "command_interface.h"
+
+// BLE UUIDs
+#define SERVICE_UUID        "3fd350f5-1c0c-4d79-847c-91877824399e"
+#define CONTROL_CHAR_UUID   "253a357f-39cb-4989-8bdf-f6b5ae8b7c65"
+#define STATUS_CHAR_UUID    "b876fdc9-618d-4ea1-a83f-7e07cc89f963"
+#define BULK_RX_CHAR_UUID   "6c1b1f1e-8d2a-4f57-9b0e-2f6a4d3c5e71"
+#define BULK_TX_CHAR_UUID   "a4e2c9d0-3b7f-4e18-8c65-91d0b2f7e34a"
+
+// Largest MTU offered for bulk transfers
+#define BLE_MAX_MTU         247
+
+// Connection intervals (units of 1.25 ms)
+#define BLE_ACTIVE_MIN_INTERVAL   0x06    // 7.5 ms
+#define BLE_ACTIVE_MAX_INTERVAL   0x12    // 22.5 ms
+#define BLE_IDLE_MIN_INTERVAL     0x50    // 100 ms
+#define BLE_IDLE_MAX_INTERVAL     0x78    // 150 ms (bounds idle wake latency)
+#define BLE_SUPERVISION_TIMEOUT   400     // 4 s (units of 10 ms)
+
+// BLE device name
+#define BLE_DEVICE_NAME     "AndroidBeaconRover"
+
+// Six-digit pairing passkey, set per rover at build time
+// (e.g. -DBLE_PASSKEY=472913). The bulk characteristics then need a bond
+// authenticated with it. 0 leaves pairing unauthenticated (Just Works)
+// and turns OTA upload off.
+#ifndef BLE_PASSKEY
+#define BLE_PASSKEY         0
+#endif
+
+class BLEManager : public BLEServerCallbacks, public BLECharacteristicCallbacks {
+public:
+  BLEManager(CommandInterface* commands);
+
+  void begin();
+  void update();
+
+  bool isConnected() const;
+  void sendStatus(const String& status);
+
+  // Control write as received by onWrite: refused while a replay runs,
+  // otherwise captured, validated and processed
+  void handleControlWrite(const uint8_t* data, size_t length);
+
+  // Refuse control writes (BUSY:REPLAY status) while a replay runs
+  void setReplayActive(bool active);
+
+  // Replayed control write: the same path without the BUSY:REPLAY gate.
+  // It counts no metrics, skips the app callback and notifies nothing.
+  void replayControlWrite(const uint8_t* data, size_t length);
+
+  // Request a slow (idle) or fast (active) connection interval
+  void setLowPowerMode(bool enabled);
+
+  // Set callback for when valid command is received
+  void setCommandReceivedCallback(void (*callback)());
+
+  // Set callback providing an extra telemetry line sent after each status
+  void setTelemetryCallback(String (*callback)());
+
+  // Bulk channel: frames written by the client go to the receiver callback
+  void setBulkReceiver(void (*receiver)(const uint8_t* data, size_t length));
+  bool sendBulk(const uint8_t* data, size_t length);
+  uint16_t getMtu() const;
+
+  // BLEServerCallbacks
+  void onConnect(BLEServer* pServer) override;
+  void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override;
+  void onDisconnect(BLEServer* pServer) override;
+
+  // BLECharacteristicCallbacks
+  void onWrite(BLECharacteristic* pCharacteristic) override;
+
+private:
+  CommandInterface* commands;
+  BLEServer* pServer;
+  BLECharacteristic* pControlCharacteristic;
+  BLECharacteristic* pStatusCharacteristic;
+  BLECharacteristic* pBulkRxCharacteristic;
+  BLECharacteristic* pBulkTxCharacteristic;
+
+  bool deviceConnected;
+  bool oldDeviceConnected;
+
+  esp_bd_addr_t remoteAddress;
+  uint16_t connectionId;
+  bool lowPowerMode;
+  volatile bool replayActive;
+
+  unsigned long lastStatusUpdate;
+  const unsigned long STATUS_UPDATE_INTERVAL = 1000; // 1 second
+
+  // Callback function pointers
+  void (*commandReceivedCallback)();
+  String (*telemetryCallback)();
+  void (*bulkReceiver)(const uint8_t* data, size_t length);
+
+  void applyConnectionParams();
+
+  void receiveControlWrite(const uint8_t* data, size_t length);
+  void processCommand(const uint8_t* data, size_t length);
+};
+
+#endif // BLE_MANAGER_H
@@ -0,0 +1,348 @@
+/*
+ * bulk_transfer.cpp
+ * Bulk transfer channel implementation
+ */
+
+#include "bulk_transfer.h"
+#include <Update.h>
+
+BulkTransfer::BulkTransfer(BLEManager* ble, MotorControl* motors)
+  : ble(ble), motors(motors), sourceCount(0), mode(MODE_IDLE), source(nullptr),
+    rxHead(0), rxTail(0), rxOverflow(false),
+    totalSize(0), sendOffset(0), ackedOffset(0),
+    window(0), blockSize(0), lastProgress(0),
+    writtenOffset(0), imageHash{0}, rebootAt(0) {
+  mbedtls_sha256_init(&sha);
+}
+
+void BulkTransfer::begin() {
+  Serial.printf("[Bulk] Initialized (%d byte blocks max)\n", BULK_MAX_PAYLOAD);
+}
+
+bool BulkTransfer::registerSource(const BulkSource& source) {
+  if (sourceCount >= BULK_MAX_STREAMS) return false;
+  sources[sourceCount++] = source;
+  return true;
+}
+
+bool BulkTransfer::isActive() const {
+  return mode != MODE_IDLE;
+}
+
+bool BulkTransfer::isUpdating() const {
+  return mode == MODE_WRITE || rebootAt != 0;
+}
+
+uint16_t BulkTransfer::crc16(const uint8_t* data, size_t length) {
+  // CRC-16/CCITT-FALSE
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+void BulkTransfer::sendFrame(BulkOp op, uint8_t stream, uint32_t offset, uint16_t param,
+                             const uint8_t* payload, uint16_t length) {
+  uint8_t frame[BULK_HEADER_SIZE + BULK_MAX_PAYLOAD];
+  BulkHeader header = {op, stream, length, offset, 0, param};
+  if (length > 0) {
+    header.crc = crc16(payload, length);
+    memcpy(frame + BULK_HEADER_SIZE, payload, length);
+  }
+  memcpy(frame, &header, BULK_HEADER_SIZE);
+  ble->sendBulk(frame, BULK_HEADER_SIZE + length);
+}
+
+void BulkTransfer::onReceive(const uint8_t* data, size_t length) {
+  // BLE task: copy the frame out and leave the rest to update()
+  if (length < BULK_HEADER_SIZE || length > sizeof(rxFrames[0].data)) return;
+
+  uint8_t next = (rxHead + 1) % BULK_RX_FRAMES;
+  if (next == rxTail) {
+    // Client overran the window; update() asks it to resend
+    rxOverflow = true;
+    return;
+  }
+
+  RxFrame& frame = rxFrames[rxHead];
+  memcpy(frame.data, data, length);
+  frame.length = length;
+  __sync_synchronize();   // Publish the frame before the index
+  rxHead = next;
+}
+
+void BulkTransfer::update(unsigned long now) {
+  // Frames queued by the BLE task, in arrival order
+  while (rxTail != rxHead) {
+    __sync_synchronize();
+    handleFrame(rxFrames[rxTail], now);
+    rxTail = (rxTail + 1) % BULK_RX_FRAMES;
+  }
+  if (rxOverflow) {
+    rxOverflow = false;
+    if (mode == MODE_WRITE) {
+      sendFrame(BULK_OP_NAK, BULK_STREAM_OTA, writtenOffset, 0);
+    }
+  }
+
+  // Release the motors while the client is away; OPEN_WRITE resumes
+  if (mode == MODE_WRITE && !ble->isConnected()) {
+    mode = MODE_IDLE;
+    Serial.printf("[Bulk] OTA paused at %lu\n", (unsigned long)writtenOffset);
+  }
+
+  // Never reboot under a moving rover
+  if (rebootAt != 0 && (long)(now - rebootAt) >= 0 && !motors->isMoving()) {
+    Serial.println("[Bulk] Rebooting into new firmware");
+    rebootAt = 0;
+    ESP.restart();
+  }
+
+  if (mode == MODE_READ) {
+    pumpRead(now);
+  }
+}
+
+void BulkTransfer::handleFrame(RxFrame& frame, unsigned long now) {
+  BulkHeader header;
+  memcpy(&header, frame.data, BULK_HEADER_SIZE);
+  uint8_t* payload = frame.data + BULK_HEADER_SIZE;
+  if (header.length != frame.length - BULK_HEADER_SIZE) return;
+
+  switch (header.op) {
+    case BULK_OP_OPEN_READ:
+      openRead(header);
+      break;
+
+    case BULK_OP_OPEN_WRITE:
+      openWrite(header, payload);
+      break;
+
+    case BULK_OP_DATA:
+      receiveData(header, payload);
+      break;
+
+    case BULK_OP_ACK:
+      if (mode == MODE_READ && header.offset > ackedOffset && header.offset <= totalSize) {
+        ackedOffset = header.offset;
+      }
+      break;
+
+    case BULK_OP_NAK:
+      if (mode == MODE_READ && header.offset <= totalSize) {
+        // Go back and resend from the requested offset
+        sendOffset = max(header.offset, ackedOffset);
+        lastProgress = now;
+      }
+      break;
+
+    case BULK_OP_END:
+      if (mode == MODE_WRITE) {
+        finishWrite(now);
+      }
+      break;
+
+    case BULK_OP_ABORT:
+      if (mode == MODE_WRITE) {
+        Update.abort();
+        writtenOffset = 0;
+      }
+      mode = MODE_IDLE;
+      Serial.println("[Bulk] Transfer aborted by client");
+      break;
+
+    default:
+      break;
+  }
+}
+
+void BulkTransfer::openRead(const BulkHeader& header) {
+  if (mode == MODE_WRITE) {
+    sendFrame(BULK_OP_ERROR, header.stream, 0, 0);
+    return;
+  }
+
+  source = nullptr;
+  for (size_t i = 0; i < sourceCount; i++) {
+    if (sources[i].stream == header.stream) source = &sources[i];
+  }
+  if (source == nullptr) {
+    sendFrame(BULK_OP_ERROR, header.stream, 0, 0);
+    return;
+  }
+
+  totalSize = source->size();
+  blockSize = min((int)BULK_MAX_PAYLOAD, ble->getMtu() - 3 - BULK_HEADER_SIZE);
+  window = constrain(header.param, 1, BULK_MAX_WINDOW);
+  sendOffset = min(header.offset, totalSize);
+  ackedOffset = sendOffset;
+  lastProgress = millis();
+  mode = MODE_READ;
+
+  sendFrame(BULK_OP_INFO, header.stream, totalSize, blockSize);
+  Serial.printf("[Bulk] Download stream %d: %lu bytes from %lu, %d x %d byte window\n",
+                header.stream, (unsigned long)totalSize, (unsigned long)sendOffset,
+                window, blockSize);
+}
+
+void BulkTransfer::openWrite(const BulkHeader& header, const uint8_t* payload) {
+  if (header.stream != BULK_STREAM_OTA || header.length < 4 + BULK_OTA_HASH_SIZE ||
+      mode == MODE_READ) {
+    sendFrame(BULK_OP_ERROR, header.stream, 0, 0);
+    return;
+  }
+
+#if !BLE_PASSKEY
+  // Unauthenticated pairing: any phone in range could flash the rover
+  Serial.println("[Bulk] OTA refused: no BLE_PASSKEY set");
+  sendFrame(BULK_OP_ERROR, BULK_STREAM_OTA, 0, 0);
+  return;
+#endif
+
+  if (motors->isMoving()) {
+    Serial.println("[Bulk] OTA refused while moving");
+    sendFrame(BULK_OP_ERROR, BULK_STREAM_OTA, 0, 0);
+    return;
+  }
+
+  uint32_t imageSize;
+  memcpy(&imageSize, payload, sizeof(imageSize));
+  const uint8_t* hash = payload + sizeof(imageSize);
+
+  if (Update.isRunning() && imageSize == totalSize &&
+      memcmp(hash, imageHash, BULK_OTA_HASH_SIZE) == 0) {
+    // Resume: the client must continue from what has been written
+    mode = MODE_WRITE;
+    BulkOp reply = (header.offset == writtenOffset) ? BULK_OP_ACK : BULK_OP_NAK;
+    sendFrame(reply, BULK_STREAM_OTA, writtenOffset, BULK_RX_QUEUE);
+    Serial.printf("[Bulk] OTA resumed at %lu\n", (unsigned long)writtenOffset);
+    return;
+  }
+
+  if (header.offset != 0) {
+    sendFrame(BULK_OP_NAK, BULK_STREAM_OTA, 0, BULK_RX_QUEUE);
+    return;
+  }
+
+  if (Update.isRunning()) {
+    Update.abort();
+  }
+
+  // Update.begin() erases lazily; it writes to the inactive OTA partition
+  if (!Update.begin(imageSize)) {
+    Serial.printf("[Bulk] OTA begin failed: %s\n", Update.errorString());
+    sendFrame(BULK_OP_ERROR, BULK_STREAM_OTA, 0, 0);
+    return;
+  }
+
+  totalSize = imageSize;
+  writtenOffset = 0;
+  memcpy(imageHash, hash, BULK_OTA_HASH_SIZE);
+  mbedtls_sha256_free(&sha);
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mode = MODE_WRITE;
+
+  sendFrame(BULK_OP_ACK, BULK_STREAM_OTA, 0, BULK_RX_QUEUE);
+  Serial.printf("[Bulk] OTA started: %lu bytes\n", (unsigned long)imageSize);
+}
+
+void BulkTransfer::receiveData(const BulkHeader& header, uint8_t* payload) {
+  if (mode != MODE_WRITE) return;
+
+  if (header.offset < writtenOffset) {
+    // Duplicate after a resend, already written
+    sendFrame(BULK_OP_ACK, BULK_STREAM_OTA, writtenOffset, 0);
+    return;
+  }
+
+  if (header.offset > writtenOffset || header.length == 0 ||
+      header.length > BULK_MAX_PAYLOAD || crc16(payload, header.length) != header.crc) {
+    sendFrame(BULK_OP_NAK, BULK_STREAM_OTA, writtenOffset, 0);
+    return;
+  }
+
+  if (writtenOffset + header.length > totalSize) {
+    failWrite("block past the image end");
+    return;
+  }
+  if (Update.write(payload, header.length) != header.length) {
+    failWrite(Update.errorString());
+    return;
+  }
+
+  mbedtls_sha256_update(&sha, payload, header.length);
+  writtenOffset += header.length;
+  sendFrame(BULK_OP_ACK, BULK_STREAM_OTA, writtenOffset, 0);
+}
+
+void BulkTransfer::finishWrite(unsigned long now) {
+  if (writtenOffset != totalSize) {
+    failWrite("image incomplete");
+    return;
+  }
+
+  uint8_t digest[BULK_OTA_HASH_SIZE];
+  mbedtls_sha256_finish(&sha, digest);
+  if (memcmp(digest, imageHash, BULK_OTA_HASH_SIZE) != 0) {
+    failWrite("SHA-256 mismatch");
+    return;
+  }
+
+  if (!Update.end()) {
+    failWrite(Update.errorString());
+    return;
+  }
+
+  mode = MODE_IDLE;
+  sendFrame(BULK_OP_END, BULK_STREAM_OTA, writtenOffset, 0);
+  Serial.println("[Bulk] OTA image verified, rebooting once stopped");
+  rebootAt = now + BULK_REBOOT_DELAY_MS;
+}
+
+void BulkTransfer::failWrite(const char* reason) {
+  Serial.printf("[Bulk] OTA failed: %s\n", reason);
+  Update.abort();
+  mode = MODE_IDLE;
+  sendFrame(BULK_OP_ERROR, BULK_STREAM_OTA, writtenOffset, 0);
+  writtenOffset = 0;
+}
+
+void BulkTransfer::pumpRead(unsigned long now) {
+  if (!ble->isConnected()) {
+    // Keep nothing in flight; the client resumes with OPEN_READ(offset)
+    mode = MODE_IDLE;
+    return;
+  }
+
+  if (ackedOffset >= totalSize) {
+    sendFrame(BULK_OP_END, source->stream, totalSize, 0);
+    mode = MODE_IDLE;
+    Serial.printf("[Bulk] Download complete (%lu bytes)\n", (unsigned long)totalSize);
+    return;
+  }
+
+  // No acknowledgement for a while: resend from the last ACK
+  if (now - lastProgress > BULK_ACK_TIMEOUT_MS) {
+    sendOffset = ackedOffset;
+    lastProgress = now;
+  }
+
+  uint8_t block[BULK_MAX_PAYLOAD];
+  uint32_t windowBytes = (uint32_t)window * blockSize;
+  for (uint8_t sent = 0; sent < BULK_BLOCKS_PER_TICK; sent++) {
+    if (sendOffset >= totalSize || sendOffset - ackedOffset >= windowBytes) break;
+
+    size_t length = min((uint32_t)blockSize, totalSize - sendOffset);
+    length = source->read(sendOffset, block, length);
+    if (length == 0) break;
+
+    sendFrame(BULK_OP_DATA, source->stream, sendOffset, 0, block, length);
+    sendOffset += length;
+    lastProgress = now;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+ * bulk_transfer.h
+ * High-throughput bulk channel over a dedicated BLE characteristic pair
+ *
+ * Frames carry a 12-byte header and an MTU-sized payload:
+ *
+ *   u8  op       BulkOp
+ *   u8  stream   BulkStream
+ *   u16 length   payload bytes
+ *   u32 offset   byte offset (or total size for INFO)
+ *   u16 crc      CRC-16/CCITT of the payload
+ *   u16 param    op-specific (window, block size)
+ *
+ * Download (rover -> client), e.g. a capture or flight recorder:
+ *   client OPEN_READ(stream, offset = resume point, param = window)
+ *   rover  INFO(offset = total size, param = block payload size)
+ *   rover  DATA blocks, at most `window` unacknowledged
+ *   client ACK(offset = next expected byte) / NAK(offset = resend from)
+ *   rover  END once everything is acknowledged
+ *
+ * Upload (client -> rover), OTA into the inactive partition:
+ *   client OPEN_WRITE(offset = resume point,
+ *                     payload = u32 image size, 32-byte SHA-256 of the image)
+ *   rover  ACK(offset, param = window) to accept, NAK(offset = bytes held)
+ *          to resume, ERROR while the motors are running or without a
+ *          BLE_PASSKEY
+ *   client DATA blocks, at most `window` unacknowledged
+ *   rover  ACK(next offset) per written block, NAK on CRC error, gap or
+ *          overrun
+ *   client END -> rover checks the SHA-256, replies END or ERROR and
+ *          reboots once the motors are stopped
+ *
+ * The SHA-256 only catches a corrupted transfer; it comes from the client.
+ * What keeps strangers from flashing the rover is the pairing: both
+ * characteristics need a bond authenticated with BLE_PASSKEY (see
+ * BLEManager::begin()), and uploads are refused when none is set. Motor
+ * commands are held from OPEN_WRITE until the upload ends, fails or the
+ * client disconnects (flash erases stall the loop and its safety checks),
+ * and through the reboot. Frames are only queued in the BLE task; all
+ * protocol state, flash writes and notifications are handled in update()
+ * from the main loop, a few blocks per tick, so the control
+ * characteristic is never starved.
+ */
+
+#ifndef BULK_TRANSFER_H
+#define BULK_TRANSFER_H
+
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+#include "ble_manager.h"
+#include "motor_control.h"
+
+#define BULK_HEADER_SIZE        12
+#define BULK_MAX_PAYLOAD        (BLE_MAX_MTU - 3 - BULK_HEADER_SIZE)
+#define BULK_MAX_WINDOW         8       // Blocks in flight (download)
+#define BULK_RX_QUEUE           4       // Upload window (blocks in flight)
+#define BULK_RX_FRAMES          (BULK_RX_QUEUE + 2)  // Ring slots: window + 1 control frame
+#define BULK_OTA_HASH_SIZE      32      // SHA-256
+#define BULK_BLOCKS_PER_TICK    4       // Notifications per loop iteration
+#define BULK_ACK_TIMEOUT_MS     1000    // Resend from last ACK after this
+#define BULK_REBOOT_DELAY_MS    1000
+#define BULK_MAX_STREAMS        4
+
+enum BulkOp : uint8_t {
+  BULK_OP_OPEN_READ  = 1,
+  BULK_OP_OPEN_WRITE = 2,
+  BULK_OP_INFO       = 3,
+  BULK_OP_DATA       = 4,
+  BULK_OP_ACK        = 5,
+  BULK_OP_NAK        = 6,
+  BULK_OP_END        = 7,
+  BULK_OP_ABORT      = 8,
+  BULK_OP_ERROR      = 9
+};
+
+enum BulkStream : uint8_t {
+  BULK_STREAM_CAPTURE = 1,    // Session capture records
+  BULK_STREAM_FLIGHT  = 2,    // Flight recorder
+  BULK_STREAM_METRICS = 3,    // Metrics snapshot (taken at OPEN_READ)
+  BULK_STREAM_OTA     = 0x80  // Firmware image (upload only)
+};
+
+struct __attribute__((packed)) BulkHeader {
+  uint8_t op;
+  uint8_t stream;
+  uint16_t length;
+  uint32_t offset;
+  uint16_t crc;
+  uint16_t param;
+};
+
+static_assert(sizeof(BulkHeader) == BULK_HEADER_SIZE, "Bulk header layout changed");
+
+// Readable stream: total size and random-access reads
+struct BulkSource {
+  uint8_t stream;
+  size_t (*size)();
+  size_t (*read)(uint32_t offset, uint8_t* buffer, size_t length);
+};
+
+class BulkTransfer {
+public:
+  BulkTransfer(BLEManager* ble, MotorControl* motors);
+
+  void begin();
+
+  // Handle received frames and pump downloads; call once per loop iteration
+  void update(unsigned long now);
+
+  // Frame received on the bulk RX characteristic (BLE task, queued only)
+  void onReceive(const uint8_t* data, size_t length);
+
+  bool registerSource(const BulkSource& source);
+
+  bool isActive() const;
+
+  // An upload is open or its reboot pending; motors must stay stopped
+  bool isUpdating() const;
+
+  static uint16_t crc16(const uint8_t* data, size_t length);
+
+private:
+  enum Mode : uint8_t {
+    MODE_IDLE,
+    MODE_READ,
+    MODE_WRITE
+  };
+
+  struct RxFrame {
+    uint16_t length;
+    uint8_t data[BULK_HEADER_SIZE + BULK_MAX_PAYLOAD];
+  };
+
+  BLEManager* ble;
+  MotorControl* motors;
+
+  BulkSource sources[BULK_MAX_STREAMS];
+  size_t sourceCount;
+
+  Mode mode;
+  const BulkSource* source;
+
+  // Frames from the BLE task: single producer, single consumer
+  RxFrame rxFrames[BULK_RX_FRAMES];
+  volatile uint8_t rxHead;            // Written by the BLE task
+  volatile uint8_t rxTail;            // Written by update()
+  volatile bool rxOverflow;
+
+  // Download state
+  uint32_t totalSize;
+  uint32_t sendOffset;
+  uint32_t ackedOffset;
+  uint16_t window;
+  uint16_t blockSize;
+  unsigned long lastProgress;
+
+  // Upload state
+  uint32_t writtenOffset;             // Bytes committed to flash
+  uint8_t imageHash[BULK_OTA_HASH_SIZE];
+  mbedtls_sha256_context sha;
+  unsigned long rebootAt;
+
+  void handleFrame(RxFrame& frame, unsigned long now);
+  void openRead(const BulkHeader& header);
+  void openWrite(const BulkHeader& header, const uint8_t* payload);
+  void receiveData(const BulkHeader& header, uint8_t* payload);
+  void finishWrite(unsigned long now);
+  void failWrite(const char* reason);
+
+  void pumpRead(unsigned long now);
+
+  void sendFrame(BulkOp op, uint8_t stream, uint32_t offset, uint16_t param,
+                 const uint8_t* payload = nullptr, uint16_t length = 0);
+};
+
+#endif // BULK_TRANSFER_H
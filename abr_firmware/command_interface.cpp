@@ -1,328 +1,570 @@
-/*
- * command_interface.cpp
- * Command protocol implementation
- */
- 
-#include "command_interface.h"
-
-CommandInterface::CommandInterface(MotorControl* motors)
-  : motors(motors), defaultSpeed(DEFAULT_SPEED),
-  moveEndTime(0), timedMoveActive(false) {
-  lastCommand = {CMD_NONE, 0, 0, false};
-}
-
-void CommandInterface::begin() {
-  Serial.printf("[Command] Interface initialized\n");
-}
-
-int16_t CommandInterface::parseNumber(const String& str, int startIndex, int endIndex) {
-  if (startIndex >= str.length()) return 0;
-  if (endIndex < 0) endIndex = str.length();
-
-  String numStr = str.substring(startIndex, endIndex);
-  numStr.trim();
-  return numStr.toInt();
-}
-
-Command CommandInterface::parse(const String& input) {
-  Command cmd = {CMD_NONE, 0, 0, false};
-
-  if (input.length() == 0) {
-    cmd.type = CMD_INVALID;
-    return cmd;
-  }
-
-  String trimmed = input;
-  trimmed.trim();
-  trimmed.toUpperCase();
-
-  char cmdChar = trimmed.charAt(0);
-
-  // Find parameter positions
-  int colon1 = trimmed.indexOf(':');
-  int colon2 = (colon1 > 0) ? trimmed.indexOf(':', colon1 + 1) : -1;
-
-  // Parse based on command character
-  switch (cmdChar) {
-    case 'F':
-      cmd.type = CMD_FORWARD;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      }
-      break;
-
-    case 'B':
-      cmd.type = CMD_BACKWARD;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      }
-      break;
-
-    case 'L':
-      cmd.type = CMD_TURN_LEFT;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      }
-      break;
-
-    case 'R':
-      cmd.type = CMD_TURN_RIGHT;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      }
-      break;
-
-    case 'G':
-      cmd.type = CMD_ROTATE_LEFT;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      }
-      break;
-
-    case 'H':
-      cmd.type = CMD_ROTATE_RIGHT;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      }
-      break;
-
-    case 'S':
-      cmd.type = CMD_STOP;
-      break;
-
-    case 'M':  // Manual: M:leftSpeed:rightSpeed
-      cmd.type = CMD_MANUAL;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else {
-        cmd.type = CMD_INVALID;
-      }
-      break;
-
-    case 'J':  // Joystick: J:x:y
-      cmd.type = CMD_JOYSTICK;
-      if (colon1 > 0 && colon2 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, colon2);
-        cmd.param2 = parseNumber(trimmed, colon2 + 1, -1);
-        cmd.hasParams = true;
-      } else {
-        cmd.type = CMD_INVALID;
-      }
-      break;
-
-    case 'V':  // Set speed: V:speed
-      cmd.type = CMD_SET_SPEED;
-      if (colon1 > 0) {
-        cmd.param1 = parseNumber(trimmed, colon1 + 1, -1);
-        cmd.hasParams = true;
-      } else {
-        cmd.type = CMD_INVALID;
-      }
-      break;
-
-    default:
-      cmd.type = CMD_INVALID;
-      break;
-  }
-
-  return cmd;
-}
-
-void CommandInterface::processJoystick(int16_t x, int16_t y) {
-  // x: -100 (left) to +100 (right)
-  // y: -100 (backward) to +100 (forward)
-
-  // Dead zone
-  if (abs(x) < 10 && abs(y) < 10) {
-    motors->stop();
-    return;
-  }
-
-  // Tank-style mixing
-  // Convert joystick to differential drive
-
-  int16_t scaledX = map(x, -100, 100, -255, 255);
-  int16_t scaledY = map(y, -100, 100, -255, 255);
-
-  int16_t leftSpeed = scaledY + scaledX;
-  int16_t rightSpeed = scaledY - scaledX;
-
-  // Constrain
-  leftSpeed = constrain(leftSpeed, -255, 255);
-  rightSpeed = constrain(rightSpeed, -255, 255);
-
-  // Determine directions and speeds
-  Direction leftDir = DIR_STOP;
-  Direction rightDir = DIR_STOP;
-  uint8_t leftSpeedAbs = 0;
-  uint8_t rightSpeedAbs = 0;
-
-  if (leftSpeed > 0) {
-    leftDir = DIR_FORWARD;
-    leftSpeedAbs = leftSpeed;
-  } else if (leftSpeed < 0) {
-    leftDir = DIR_BACKWARD;
-    leftSpeedAbs = -leftSpeed;
-  }
-
-  if (rightSpeed > 0) {
-    rightDir = DIR_FORWARD;
-    rightSpeedAbs = rightSpeed;
-  } else if (rightSpeed < 0) {
-    rightDir = DIR_BACKWARD;
-    rightSpeedAbs = -rightSpeed;
-  }
-
-  motors->setMotors(leftDir, leftSpeedAbs, rightDir, rightSpeedAbs);
-
-  Serial.printf("[Command] Joystick x=%d y=%d -> L:%d R:%d\n",
-                x, y, leftSpeed, rightSpeed);
-}
-
-void CommandInterface::execute(const Command& cmd) {
-  uint8_t speed = cmd.hasParams ? cmd.param1 : defaultSpeed;
-  bool isTimedCommand = cmd.hasParams && cmd.param2 > 0;
-
-  switch (cmd.type) {
-    case CMD_FORWARD:
-      motors->forward(speed);
-      if (isTimedCommand) {
-        timedMoveActive = true;
-        moveEndTime = millis() + cmd.param2;
-        Serial.printf("[Command] Forward speed=%d for %dms\n", speed, cmd.param2);
-      }
-      break;
-
-    case CMD_BACKWARD:
-      motors->backward(speed);
-      if (isTimedCommand) {
-        timedMoveActive = true;
-        moveEndTime = millis() + cmd.param2;
-        Serial.printf("[Command] Backward speed=%d for %dms\n", speed, cmd.param2);
-      }
-      break;
-
-    case CMD_TURN_LEFT:
-      motors->turnLeft(speed);
-      if (isTimedCommand) {
-        timedMoveActive = true;
-        moveEndTime = millis() + cmd.param2;
-        Serial.printf("[Command] Turn left speed=%d for %dms\n", speed, cmd.param2);
-      }
-      break;
-
-    case CMD_TURN_RIGHT:
-      motors->turnRight(speed);
-      if (isTimedCommand) {
-        timedMoveActive = true;
-        moveEndTime = millis() + cmd.param2;
-        Serial.printf("[Command] Turn right speed=%d for %dms\n", speed, cmd.param2);
-      }
-      break;
-
-    case CMD_ROTATE_LEFT:
-      motors->rotateLeft(speed);
-      if (isTimedCommand) {
-        timedMoveActive = true;
-        moveEndTime = millis() + cmd.param2;
-        Serial.printf("[Command] Rotate left speed=%d for %dms\n", speed, cmd.param2);
-      }
-      break;
-
-    case CMD_ROTATE_RIGHT:
-      motors->rotateRight(speed);
-      if (isTimedCommand) {
-        timedMoveActive = true;
-        moveEndTime = millis() + cmd.param2;
-        Serial.printf("[Command] Rotate right speed=%d for %dms\n", speed, cmd.param2);
-      }
-      break;
-
-    case CMD_STOP:
-      motors->stop();
-      timedMoveActive = false;
-      break;
-
-    case CMD_MANUAL: {
-      // param1 = left, param2 = right (signed values)
-      Direction leftDir = (cmd.param1 >= 0) ? DIR_FORWARD : DIR_BACKWARD;
-      Direction rightDir = (cmd.param2 >= 0) ? DIR_FORWARD : DIR_BACKWARD;
-      motors->setMotors(leftDir, abs(cmd.param1), rightDir, abs(cmd.param2));
-      timedMoveActive = false;
-      Serial.printf("[Command] Manual L:%d R:%d\n", cmd.param1, cmd.param2);
-      break;
-    }
-
-    case CMD_JOYSTICK:
-      processJoystick(cmd.param1, cmd.param2);
-      timedMoveActive = false;
-      break;
-
-    case CMD_SET_SPEED:
-      defaultSpeed = constrain(cmd.param1, MIN_SPEED, MAX_SPEED);
-      Serial.printf("[Command] Speed set to %d\n", defaultSpeed);
-      break;
-
-    case CMD_INVALID:
-      Serial.printf("[Command] Invalid command\n");
-      break;
-
-    default:
-      break;
-  }
-
-  lastCommand = cmd;
-}
-
-void CommandInterface::update() {
-  if (timedMoveActive && millis() >= moveEndTime) {
-    motors->stop();
-    timedMoveActive = false;
-    Serial.printf("[Command] Timed move completed\n");
-  }
-}
-
-void CommandInterface::process(const String& input) {
-  Command cmd = parse(input);
-  execute(cmd);
-}
-
-String CommandInterface::getStatus() const {
-  String status = "STATUS:";
-  status += motors->isMoving() ? "MOVING" : "STOPPED";
-  status += ":";
-  status += String(defaultSpeed);
-  return status;
+/*
+ * command_interface.cpp
+ * Command protocol implementation
+ */
+ 
+#include "command_interface.h"
+#include "flight_recorder.h"
+
+CommandInterface::CommandInterface(MotorControl* motors, MotionModel* motion)
+  : motors(motors), motion(motion), position(nullptr), clock(millis),
+  defaultSpeed(DEFAULT_SPEED), moveEndTime(0), timedMoveActive(false),
+  targetX(0), targetY(0), hasTarget(false), responseLength(0),
+  mutex(xSemaphoreCreateRecursiveMutex()) {
+  lastCommand = {CMD_NONE, 0, 0, 0, false};
+  lastMotion = {MOTION_LINEAR, 1, 0, 0, 0, false};
+}
+
+void CommandInterface::begin() {
+  Serial.printf("[Command] Interface initialized\n");
+}
+
+/*
+ * Command registry
+ *
+ * One row per opcode. minArgs/maxArgs describe the colon-separated (or
+ * binary int16) arguments; extra arguments are ignored, missing
+ * required ones make the command invalid. New commands only need a row
+ * and a handler - the parser and dispatcher stay unchanged.
+ */
+constexpr CommandSpec CommandInterface::commandTable[] = {
+  // opcode type            min max handler                                  move                         reverse                     kind             sign name
+  { 'F', CMD_FORWARD,       0, 2, &CommandInterface::handleTimedMove,      &MotorControl::forward,      nullptr,                    MOTION_LINEAR,    1, "Forward"      },
+  { 'B', CMD_BACKWARD,      0, 2, &CommandInterface::handleTimedMove,      &MotorControl::backward,     nullptr,                    MOTION_LINEAR,   -1, "Backward"     },
+  { 'L', CMD_TURN_LEFT,     0, 2, &CommandInterface::handleTimedMove,      &MotorControl::turnLeft,     nullptr,                    -1,               1, "Turn left"    },
+  { 'R', CMD_TURN_RIGHT,    0, 2, &CommandInterface::handleTimedMove,      &MotorControl::turnRight,    nullptr,                    -1,               1, "Turn right"   },
+  { 'G', CMD_ROTATE_LEFT,   0, 2, &CommandInterface::handleTimedMove,      &MotorControl::rotateLeft,   nullptr,                    MOTION_ROTATION, -1, "Rotate left"  },
+  { 'H', CMD_ROTATE_RIGHT,  0, 2, &CommandInterface::handleTimedMove,      &MotorControl::rotateRight,  nullptr,                    MOTION_ROTATION,  1, "Rotate right" },
+  { 'S', CMD_STOP,          0, 0, &CommandInterface::handleStop,           nullptr,                     nullptr,                    -1,               1, "Stop"         },
+  { 'M', CMD_MANUAL,        2, 2, &CommandInterface::handleManual,         nullptr,                     nullptr,                    -1,               1, "Manual"       },
+  { 'J', CMD_JOYSTICK,      2, 2, &CommandInterface::handleJoystick,       nullptr,                     nullptr,                    -1,               1, "Joystick"     },
+  { 'V', CMD_SET_SPEED,     1, 1, &CommandInterface::handleSetSpeed,       nullptr,                     nullptr,                    -1,               1, "Set speed"    },
+  { 'D', CMD_DISTANCE,      1, 2, &CommandInterface::handlePhysicalMove,   &MotorControl::forward,      &MotorControl::backward,    MOTION_LINEAR,    1, "Drive"        },
+  { 'T', CMD_TURN,          1, 2, &CommandInterface::handlePhysicalMove,   &MotorControl::rotateRight,  &MotorControl::rotateLeft,  MOTION_ROTATION,  1, "Turn"         },
+  { 'K', CMD_FEEDBACK,      1, 1, &CommandInterface::handleFeedback,       nullptr,                     nullptr,                    -1,               1, "Feedback"     },
+  { 'A', CMD_BEACON,        3, 3, &CommandInterface::handleBeacon,         nullptr,                     nullptr,                    -1,               1, "Beacon"       },
+  { 'P', CMD_RANGE,         2, 2, &CommandInterface::handleRange,          nullptr,                     nullptr,                    -1,               1, "Range"        },
+  { 'N', CMD_TARGET,        2, 2, &CommandInterface::handleTarget,         nullptr,                     nullptr,                    -1,               1, "Target"       },
+  { 'W', CMD_POSITION,      0, 0, &CommandInterface::handlePosition,       nullptr,                     nullptr,                    -1,               1, "Position"     },
+  { '?', CMD_QUERY,         0, 0, &CommandInterface::handleQuery,          nullptr,                     nullptr,                    -1,               1, "Query"        },
+  { 'Q', CMD_METRICS,       0, 0, &CommandInterface::handleMetrics,        nullptr,                     nullptr,                    -1,               1, "Metrics"      },
+};
+
+constexpr size_t CommandInterface::commandCount =
+  sizeof(CommandInterface::commandTable) / sizeof(CommandInterface::commandTable[0]);
+
+// Opcode and type lookup tables, built at compile time
+#define OPCODE_RANGE  0x80
+#define NO_COMMAND    0xFF
+
+struct CommandIndex {
+  uint8_t byOpcode[OPCODE_RANGE];
+  uint8_t byType[CMD_TYPE_COUNT];
+};
+
+static constexpr CommandIndex buildIndex() {
+  CommandIndex index{};
+  for (size_t i = 0; i < OPCODE_RANGE; i++) index.byOpcode[i] = NO_COMMAND;
+  for (size_t i = 0; i < CMD_TYPE_COUNT; i++) index.byType[i] = NO_COMMAND;
+  for (size_t i = 0; i < CommandInterface::commandCount; i++) {
+    const CommandSpec& spec = CommandInterface::commandTable[i];
+    index.byOpcode[(uint8_t)spec.opcode] = i;
+    index.byType[spec.type] = i;
+  }
+  return index;
+}
+
+static constexpr CommandIndex COMMAND_INDEX = buildIndex();
+
+// Compile-time schema validation
+static constexpr bool opcodesValid() {
+  for (size_t i = 0; i < CommandInterface::commandCount; i++) {
+    char op = CommandInterface::commandTable[i].opcode;
+    // Printable, and upper case because text input is case-insensitive
+    if (op <= ' ' || op >= OPCODE_RANGE - 1 || (op >= 'a' && op <= 'z')) return false;
+    for (size_t j = i + 1; j < CommandInterface::commandCount; j++) {
+      if (CommandInterface::commandTable[j].opcode == op) return false;
+    }
+  }
+  return true;
+}
+
+static constexpr bool typesUnique() {
+  for (size_t i = 0; i < CommandInterface::commandCount; i++) {
+    CommandType type = CommandInterface::commandTable[i].type;
+    if (type == CMD_NONE || type == CMD_INVALID) return false;
+    for (size_t j = i + 1; j < CommandInterface::commandCount; j++) {
+      if (CommandInterface::commandTable[j].type == type) return false;
+    }
+  }
+  return true;
+}
+
+static constexpr bool schemasValid() {
+  for (size_t i = 0; i < CommandInterface::commandCount; i++) {
+    const CommandSpec& spec = CommandInterface::commandTable[i];
+    if (spec.minArgs > spec.maxArgs || spec.maxArgs > COMMAND_MAX_ARGS) return false;
+    if (spec.handler == nullptr || spec.name == nullptr) return false;
+    if (spec.motionKind >= MOTION_KIND_COUNT) return false;
+    if (spec.sign != 1 && spec.sign != -1) return false;
+    if (spec.reverse != nullptr && spec.move == nullptr) return false;
+  }
+  return true;
+}
+
+static_assert(CommandInterface::commandCount < NO_COMMAND, "Command table too large for index");
+static_assert(opcodesValid(), "Command opcodes must be unique printable upper-case ASCII");
+static_assert(typesUnique(), "Each command type needs exactly one registry entry");
+static_assert(schemasValid(), "Invalid command argument schema");
+
+// Decode one signed decimal field, clamped to int16 range
+static int16_t parseNumber(const char* p, const char* end) {
+  while (p < end && *p == ' ') p++;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  int32_t value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (value <= INT16_MAX) value = value * 10 + (*p - '0');
+    p++;
+  }
+
+  if (negative) value = -value;
+  return constrain(value, INT16_MIN, INT16_MAX);
+}
+
+// Speed argument as the duty it drives at; out-of-range values clamp
+// to the motor limits instead of wrapping in uint8_t
+static uint8_t speedArgument(int16_t value) {
+  return constrain(value, MIN_SPEED, MAX_SPEED);
+}
+
+Command CommandInterface::decode(const CommandSpec* spec, const int16_t* args, uint8_t argCount) {
+  Command cmd = {CMD_INVALID, 0, 0, 0, false};
+
+  if (spec == nullptr || argCount < spec->minArgs) {
+    return cmd;
+  }
+  if (argCount > spec->maxArgs) {
+    argCount = spec->maxArgs;
+  }
+
+  cmd.type = spec->type;
+  if (argCount > 0) cmd.param1 = args[0];
+  if (argCount > 1) cmd.param2 = args[1];
+  if (argCount > 2) cmd.param3 = args[2];
+  cmd.hasParams = argCount > 0;
+  return cmd;
+}
+
+Command CommandInterface::parseText(const char* text, size_t length) {
+  const char* p = text;
+  const char* end = text + length;
+
+  // Trim surrounding whitespace
+  while (p < end && isspace((unsigned char)*p)) p++;
+  while (end > p && isspace((unsigned char)end[-1])) end--;
+
+  if (p == end) {
+    return decode(nullptr, nullptr, 0);
+  }
+
+  uint8_t opcode = toupper((unsigned char)*p);
+  uint8_t slot = (opcode < OPCODE_RANGE) ? COMMAND_INDEX.byOpcode[opcode] : NO_COMMAND;
+  const CommandSpec* spec = (slot != NO_COMMAND) ? &commandTable[slot] : nullptr;
+
+  // Colon-separated arguments
+  int16_t args[COMMAND_MAX_ARGS];
+  uint8_t argCount = 0;
+  const char* colon = (const char*)memchr(p, ':', end - p);
+  while (colon != nullptr && argCount < COMMAND_MAX_ARGS) {
+    const char* field = colon + 1;
+    colon = (const char*)memchr(field, ':', end - field);
+    args[argCount++] = parseNumber(field, colon ? colon : end);
+  }
+
+  return decode(spec, args, argCount);
+}
+
+Command CommandInterface::parseBinary(const uint8_t* data, size_t length) {
+  uint8_t opcode = data[0] & ~BINARY_OPCODE_FLAG;
+  uint8_t slot = COMMAND_INDEX.byOpcode[opcode];
+  const CommandSpec* spec = (slot != NO_COMMAND) ? &commandTable[slot] : nullptr;
+
+  // Little-endian int16 arguments
+  int16_t args[COMMAND_MAX_ARGS];
+  uint8_t argCount = 0;
+  for (size_t i = 1; i + 1 < length && argCount < COMMAND_MAX_ARGS; i += 2) {
+    args[argCount++] = (int16_t)(data[i] | (data[i + 1] << 8));
+  }
+
+  return decode(spec, args, argCount);
+}
+
+Command CommandInterface::parse(const String& input) {
+  return parseText(input.c_str(), input.length());
+}
+
+Command CommandInterface::parse(const uint8_t* data, size_t length) {
+  if (length > 0 && (data[0] & BINARY_OPCODE_FLAG)) {
+    return parseBinary(data, length);
+  }
+  return parseText((const char*)data, length);
+}
+
+void CommandInterface::processJoystick(int16_t x, int16_t y) {
+  // x: -100 (left) to +100 (right)
+  // y: -100 (backward) to +100 (forward)
+
+  // Dead zone
+  if (abs(x) < 10 && abs(y) < 10) {
+    motors->stop();
+    return;
+  }
+
+  // Tank-style mixing
+  // Convert joystick to differential drive
+
+  int16_t scaledX = map(x, -100, 100, -255, 255);
+  int16_t scaledY = map(y, -100, 100, -255, 255);
+
+  int16_t leftSpeed = scaledY + scaledX;
+  int16_t rightSpeed = scaledY - scaledX;
+
+  // Constrain
+  leftSpeed = constrain(leftSpeed, -255, 255);
+  rightSpeed = constrain(rightSpeed, -255, 255);
+
+  // Determine directions and speeds
+  Direction leftDir = DIR_STOP;
+  Direction rightDir = DIR_STOP;
+  uint8_t leftSpeedAbs = 0;
+  uint8_t rightSpeedAbs = 0;
+
+  if (leftSpeed > 0) {
+    leftDir = DIR_FORWARD;
+    leftSpeedAbs = leftSpeed;
+  } else if (leftSpeed < 0) {
+    leftDir = DIR_BACKWARD;
+    leftSpeedAbs = -leftSpeed;
+  }
+
+  if (rightSpeed > 0) {
+    rightDir = DIR_FORWARD;
+    rightSpeedAbs = rightSpeed;
+  } else if (rightSpeed < 0) {
+    rightDir = DIR_BACKWARD;
+    rightSpeedAbs = -rightSpeed;
+  }
+
+  motors->setMotors(leftDir, leftSpeedAbs, rightDir, rightSpeedAbs);
+
+  Serial.printf("[Command] Joystick x=%d y=%d -> L:%d R:%d\n",
+                x, y, leftSpeed, rightSpeed);
+}
+
+void CommandInterface::execute(const Command& cmd) {
+  lock();
+  uint8_t slot = (cmd.type < CMD_TYPE_COUNT) ? COMMAND_INDEX.byType[cmd.type] : NO_COMMAND;
+
+  if (slot == NO_COMMAND) {
+    // Replayed commands are not part of this run's history
+    if (!motors->isDryRun()) {
+      metrics.increment(CTR_INVALID_COMMANDS);
+      flight.recordCommand(0, cmd.param1, cmd.param2, cmd.param3);
+    }
+    Serial.printf("[Command] Invalid command\n");
+  } else {
+    const CommandSpec& spec = commandTable[slot];
+    if (!motors->isDryRun()) {
+      flight.recordCommand(spec.opcode, cmd.param1, cmd.param2, cmd.param3);
+    }
+    (this->*spec.handler)(cmd, spec);
+  }
+
+  lastCommand = cmd;
+  unlock();
+}
+
+void CommandInterface::handleTimedMove(const Command& cmd, const CommandSpec& spec) {
+  uint8_t speed = cmd.hasParams ? speedArgument(cmd.param1) : defaultSpeed;
+  (motors->*spec.move)(speed);
+
+  // The new pattern supersedes a running move, whose odometry ends here
+  endTimedMove();
+  if (spec.motionKind < 0) {
+    lastMotion.valid = false;  // Arcs are not part of the motion model
+  }
+
+  if (cmd.hasParams && cmd.param2 > 0) {
+    if (!motors->isMoving()) {
+      // Refused by a motor guard: nothing to time or feed back
+      lastMotion.valid = false;
+      Serial.printf("[Command] %s blocked\n", spec.name);
+      return;
+    }
+    if (spec.motionKind >= 0) {
+      startTimedMove((MotionKind)spec.motionKind, spec.sign, speed, cmd.param2);
+    } else {
+      timedMoveActive = true;
+      moveEndTime = clock() + cmd.param2;
+    }
+    Serial.printf("[Command] %s speed=%d for %dms\n", spec.name, speed, cmd.param2);
+  }
+}
+
+void CommandInterface::handleStop(const Command& /*cmd*/, const CommandSpec& /*spec*/) {
+  motors->stop();
+  endTimedMove();
+}
+
+void CommandInterface::handlePhysicalMove(const Command& cmd, const CommandSpec& spec) {
+  MotionKind kind = (MotionKind)spec.motionKind;
+  uint8_t moveSpeed = (cmd.param2 > 0) ? speedArgument(cmd.param2) : defaultSpeed;
+  MotionPlan plan = motion->plan(kind, cmd.param1, moveSpeed);
+  if (plan.durationMs == 0) {
+    Serial.printf("[Command] %s 0 - nothing to do\n", spec.name);
+    return;
+  }
+
+  // Positive amounts use the forward/right pattern, negative the reverse
+  if (cmd.param1 >= 0) {
+    (motors->*spec.move)(plan.speed);
+  } else {
+    (motors->*spec.reverse)(plan.speed);
+  }
+  if (!motors->isMoving()) {
+    // Refused by a motor guard; a running move ends here
+    endTimedMove();
+    lastMotion.valid = false;
+    Serial.printf("[Command] %s %d blocked\n", spec.name, cmd.param1);
+    return;
+  }
+  startTimedMove(kind, (cmd.param1 >= 0) ? 1 : -1, plan.speed, plan.durationMs);
+
+  Serial.printf("[Command] %s %d%s -> speed=%d for %dms\n",
+                spec.name, cmd.param1, kind == MOTION_LINEAR ? "mm" : "deg",
+                plan.speed, plan.durationMs);
+}
+
+void CommandInterface::handleFeedback(const Command& cmd, const CommandSpec& /*spec*/) {
+  if (!lastMotion.valid || timedMoveActive) {
+    Serial.printf("[Command] No completed move for feedback\n");
+    return;
+  }
+  motion->addObservation(lastMotion.kind, lastMotion.speed,
+                         lastMotion.durationMs, abs(cmd.param1));
+  lastMotion.valid = false;
+}
+
+void CommandInterface::handleManual(const Command& cmd, const CommandSpec& /*spec*/) {
+  // param1 = left, param2 = right (signed values)
+  Direction leftDir = (cmd.param1 >= 0) ? DIR_FORWARD : DIR_BACKWARD;
+  Direction rightDir = (cmd.param2 >= 0) ? DIR_FORWARD : DIR_BACKWARD;
+  motors->setMotors(leftDir, abs(cmd.param1), rightDir, abs(cmd.param2));
+  endTimedMove();
+  lastMotion.valid = false;
+  Serial.printf("[Command] Manual L:%d R:%d\n", cmd.param1, cmd.param2);
+}
+
+void CommandInterface::handleJoystick(const Command& cmd, const CommandSpec& /*spec*/) {
+  processJoystick(cmd.param1, cmd.param2);
+  endTimedMove();
+  lastMotion.valid = false;
+}
+
+void CommandInterface::handleSetSpeed(const Command& cmd, const CommandSpec& /*spec*/) {
+  defaultSpeed = constrain(cmd.param1, MIN_SPEED, MAX_SPEED);
+  Serial.printf("[Command] Speed set to %d\n", defaultSpeed);
+}
+
+void CommandInterface::handleQuery(const Command& /*cmd*/, const CommandSpec& /*spec*/) {
+  String status = getStatus();
+  responseLength = min((size_t)status.length(), sizeof(response));
+  memcpy(response, status.c_str(), responseLength);
+}
+
+void CommandInterface::handleMetrics(const Command& /*cmd*/, const CommandSpec& /*spec*/) {
+  responseLength = metrics.snapshot(response, sizeof(response));
+}
+
+void CommandInterface::handleBeacon(const Command& cmd, const CommandSpec& /*spec*/) {
+  if (position == nullptr) {
+    Serial.printf("[Command] Positioning not available\n");
+    return;
+  }
+  if (position->setBeacon(cmd.param1, cmd.param2, cmd.param3)) {
+    Serial.printf("[Command] Beacon %d at (%d, %d)mm\n", cmd.param1, cmd.param2, cmd.param3);
+  } else {
+    Serial.printf("[Command] Beacon table full (max %d)\n", POSITION_MAX_BEACONS);
+  }
+}
+
+void CommandInterface::handleRange(const Command& cmd, const CommandSpec& /*spec*/) {
+  if (position == nullptr) return;
+
+  bool wasValid = position->isValid();
+  position->updateRssi(cmd.param1, cmd.param2);
+  if (!wasValid && position->isValid()) {
+    Serial.printf("[Command] Position fix (%.0f, %.0f)mm\n",
+                  position->getX(), position->getY());
+  }
+}
+
+void CommandInterface::handleTarget(const Command& cmd, const CommandSpec& /*spec*/) {
+  targetX = cmd.param1;
+  targetY = cmd.param2;
+  hasTarget = true;
+  Serial.printf("[Command] Target (%d, %d)mm\n", targetX, targetY);
+}
+
+void CommandInterface::handlePosition(const Command& /*cmd*/, const CommandSpec& /*spec*/) {
+  bool valid = false;
+  float x = 0, y = 0, heading = 0, bearing = 0, distance = 0;
+  if (position != nullptr) {
+    valid = position->isValid();
+    x = position->getX();
+    y = position->getY();
+    heading = position->getHeading();
+    bearing = position->bearingTo(targetX, targetY);
+    distance = position->distanceTo(targetX, targetY);
+  }
+
+  String result = "POS:";
+  if (!valid) {
+    result += "NONE";
+  } else {
+    result += String((int)x);
+    result += ":";
+    result += String((int)y);
+    result += ":";
+    result += String((int)(heading * RAD_TO_DEG));
+    if (hasTarget) {
+      // Bearing uses the T convention: positive = turn right
+      result += ":";
+      result += String((int)(-bearing * RAD_TO_DEG));
+      result += ":";
+      result += String((int)distance);
+    }
+  }
+
+  responseLength = min((size_t)result.length(), sizeof(response));
+  memcpy(response, result.c_str(), responseLength);
+}
+
+void CommandInterface::startTimedMove(MotionKind kind, int8_t sign, uint8_t speed, uint16_t durationMs) {
+  // A new move ends the previous one where it is
+  endTimedMove();
+
+  unsigned long now = clock();
+  timedMoveActive = true;
+  moveEndTime = now + durationMs;
+  lastMotion = {kind, sign, speed, durationMs, now, true};
+}
+
+void CommandInterface::endTimedMove() {
+  if (!timedMoveActive) return;
+  timedMoveActive = false;
+  if (!lastMotion.valid) return;  // Arcs are not modeled
+
+  // Interrupted: feedback and odometry apply to the time actually driven
+  unsigned long elapsed = clock() - lastMotion.startTime;
+  if (elapsed < lastMotion.durationMs) {
+    lastMotion.durationMs = elapsed;
+  }
+
+  if (position != nullptr) {
+    float amount = lastMotion.sign *
+      motion->displacement(lastMotion.kind, lastMotion.speed, lastMotion.durationMs);
+    if (lastMotion.kind == MOTION_LINEAR) {
+      position->predict(amount, 0.0f);
+    } else {
+      // Positive rotations are clockwise, the estimator uses CCW
+      position->predict(0.0f, -amount * DEG_TO_RAD);
+    }
+  }
+}
+
+void CommandInterface::setPositionEstimator(PositionEstimator* position) {
+  this->position = position;
+}
+
+void CommandInterface::reset() {
+  defaultSpeed = DEFAULT_SPEED;
+  timedMoveActive = false;
+  lastMotion.valid = false;
+  lastCommand = {CMD_NONE, 0, 0, 0, false};
+}
+
+void CommandInterface::setClock(unsigned long (*clock)()) {
+  this->clock = (clock != nullptr) ? clock : millis;
+}
+
+void CommandInterface::lock() {
+  xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+}
+
+void CommandInterface::unlock() {
+  xSemaphoreGiveRecursive(mutex);
+}
+
+void CommandInterface::update() {
+  lock();
+  if (timedMoveActive && clock() >= moveEndTime) {
+    motors->stop();
+    endTimedMove();
+    Serial.printf("[Command] Timed move completed\n");
+  } else if (timedMoveActive && !motors->isMoving()) {
+    // Stopped underneath us (obstacle guard, safety timeout)
+    endTimedMove();
+    Serial.printf("[Command] Timed move interrupted\n");
+  }
+  unlock();
+}
+
+void CommandInterface::process(const String& input) {
+  process((const uint8_t*)input.c_str(), input.length());
+}
+
+void CommandInterface::process(const uint8_t* data, size_t length) {
+  lock();
+  uint32_t parseStart = micros();
+  Command cmd = parse(data, length);
+  metrics.record(HIST_PARSE_US, micros() - parseStart);
+  metrics.increment(CTR_COMMANDS);
+
+  execute(cmd);
+
+  // Commands that did not touch the motors must not leave a pending
+  // latency sample behind for the next actuation
+  metrics.clearCommandStart();
+  unlock();
+}
+
+bool CommandInterface::hasResponse() const {
+  return responseLength > 0;
+}
+
+const uint8_t* CommandInterface::getResponse() const {
+  return response;
+}
+
+size_t CommandInterface::getResponseLength() const {
+  return responseLength;
+}
+
+void CommandInterface::clearResponse() {
+  responseLength = 0;
+}
+
+String CommandInterface::getStatus() const {
+  String status = "STATUS:";
+  status += motors->isMoving() ? "MOVING" : "STOPPED";
+  status += ":";
+  status += String(defaultSpeed);
+  return status;
 }
\ No newline at end of file
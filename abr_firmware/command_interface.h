@@ -1,97 +1,232 @@
-/*
- * command_interface.h
- * Command protocol definition and parser
- *
- * Command Format (simple text-based protocol):
- * Single character commands:
- *   F - Forward
- *   B - Backward
- *   L - Turn Left
- *   R - Turn Right
- *   G - Rotate Left (spin)
- *   H - Rotate Right (spin)
- *   S - Stop
- *
- * With parameters (colon-separated):
- *   F:200     - Forward at speed 200
- *   F:200:100 - Forward at speed 200 for 100ms
- *   B:180     - Backward at speed 180
- *   B:180:100 - Backward at speed 180 for 100ms
- *   M:200:220 - Manual mode: left speed, right speed (signed: negative = backward)
- *   V:200     - Set default speed to 200
- *   G:100     - Rotate Left for 100ms
- *   H:100     - Rotate Right for 100ms
- *
- * Joystick mode (for smooth Android control):
- *   J:x:y     - Joystick input where x,y are -100 to 100
- *               x = left/right, y = forward/backward
- */
-
-#ifndef COMMAND_INTERFACE_H
-#define COMMAND_INTERFACE_H
-
-#include <Arduino.h>
-#include "motor_control.h"
-
-// Command types
-enum CommandType {
-  CMD_NONE,
-  CMD_FORWARD,
-  CMD_BACKWARD,
-  CMD_TURN_LEFT,
-  CMD_TURN_RIGHT,
-  CMD_ROTATE_LEFT,
-  CMD_ROTATE_RIGHT,
-  CMD_STOP,
-  CMD_MANUAL,       // Direct motor control
-  CMD_JOYSTICK,     // Joystick x,y input
-  CMD_SET_SPEED,    // Set default speed
-  CMD_QUERY,        // Query status
-  CMD_INVALID
-};
-
-// Parsed command structure
-struct Command {
-  CommandType type;
-  int16_t param1;   // Speed or X value
-  int16_t param2;   // Y value (for joystick/manual)
-  bool hasParams;
-};
-
-class CommandInterface {
-public:
-  CommandInterface(MotorControl* motors);
-
-  void begin();
-
-  // Parse a command string
-  Command parse(const String& input);
-
-  // Execute a parsed command
-  void execute(const Command& cmd);
-
-  // Parse and execute in one step
-  void process(const String& input);
-
-  // Get status string for query response
-  String getStatus() const;
-
-  // Check timed moves
-  void update();
-
-private:
-  MotorControl* motors;
-  uint8_t defaultSpeed;
-  Command lastCommand;
-
-  unsigned long moveEndTime;
-  bool timedMoveActive;
-
-  // Joystick mixing algorithm
-  void processJoystick(int16_t x, int16_t y);
-
-  // Parse helper
-  int16_t parseNumber(const String& str, int startIndex, int endIndex);
-};
-
+/*
+ * command_interface.h
+ * Command protocol definition and parser
+ *
+ * Command Format (simple text-based protocol):
+ * Single character commands:
+ *   F - Forward
+ *   B - Backward
+ *   L - Turn Left
+ *   R - Turn Right
+ *   G - Rotate Left (spin)
+ *   H - Rotate Right (spin)
+ *   S - Stop
+ *
+ * With parameters (colon-separated):
+ *   F:200     - Forward at speed 200
+ *   F:200:100 - Forward at speed 200 for 100ms
+ *   B:180     - Backward at speed 180
+ *   B:180:100 - Backward at speed 180 for 100ms
+ *   M:200:220 - Manual mode: left speed, right speed (signed: negative = backward)
+ *   V:200     - Set default speed to 200
+ *   G:100     - Rotate Left for 100ms
+ *   H:100     - Rotate Right for 100ms
+ *
+ * Physical units (duration from the calibrated motion model):
+ *   D:500     - Drive 500mm (negative = backward) at default speed
+ *   D:500:200 - Drive 500mm at speed 200
+ *   T:90      - Rotate 90 degrees in place (positive = right, negative = left)
+ *   T:-45:185 - Rotate 45 degrees left at speed 185
+ *   K:480     - Feedback: last move actually covered 480mm (or degrees)
+ *
+ * Positioning (millimetres, see position_estimator.h):
+ *   A:1:0:5000 - Beacon 1 is at x=0, y=5000
+ *   P:1:-72    - RSSI sample of -72 dBm from beacon 1
+ *   N:2500:3000 - Navigation target at x=2500, y=3000
+ *   W          - Position query: POS:x:y:heading:bearing:distance
+ *                (degrees; bearing positive = target to the right, as T)
+ *
+ * Queries (response returned via getResponse):
+ *   ?         - Status string
+ *   Q         - Binary metrics snapshot (see metrics.h)
+ *
+ * Joystick mode (for smooth Android control):
+ *   J:x:y     - Joystick input where x,y are -100 to 100
+ *               x = left/right, y = forward/backward
+ *
+ * Binary form (BLE): one opcode byte (text opcode | 0x80) followed by
+ * up to COMMAND_MAX_ARGS little-endian int16 arguments, e.g.
+ *   0xC6 C8 00 E8 03  ==  F:200:1000
+ *
+ * Commands are described by a constexpr table (commandTable) mapping
+ * opcodes to argument schemas and handlers. The table is validated at
+ * compile time and indexed by opcode, so dispatch is a single lookup.
+ */
+
+#ifndef COMMAND_INTERFACE_H
+#define COMMAND_INTERFACE_H
+
+#include <Arduino.h>
+#include "motor_control.h"
+#include "metrics.h"
+#include "motion_model.h"
+#include "position_estimator.h"
+
+#define RESPONSE_MAX_LENGTH  METRICS_SNAPSHOT_MAX
+#define COMMAND_MAX_LENGTH   64      // Longest accepted BLE control write
+#define COMMAND_MAX_ARGS     3
+#define BINARY_OPCODE_FLAG   0x80
+
+// Command types
+enum CommandType {
+  CMD_NONE,
+  CMD_FORWARD,
+  CMD_BACKWARD,
+  CMD_TURN_LEFT,
+  CMD_TURN_RIGHT,
+  CMD_ROTATE_LEFT,
+  CMD_ROTATE_RIGHT,
+  CMD_STOP,
+  CMD_MANUAL,       // Direct motor control
+  CMD_JOYSTICK,     // Joystick x,y input
+  CMD_SET_SPEED,    // Set default speed
+  CMD_DISTANCE,     // Drive a distance in mm
+  CMD_TURN,         // Rotate in place by degrees
+  CMD_FEEDBACK,     // Observed displacement of the last move
+  CMD_BEACON,       // Configure a positioning beacon
+  CMD_RANGE,        // Beacon RSSI sample
+  CMD_TARGET,       // Set navigation target
+  CMD_POSITION,     // Query position estimate
+  CMD_QUERY,        // Query status
+  CMD_METRICS,      // Query metrics snapshot
+  CMD_INVALID,
+  CMD_TYPE_COUNT
+};
+
+// Parsed command structure
+struct Command {
+  CommandType type;
+  int16_t param1;   // Speed or X value
+  int16_t param2;   // Y value (for joystick/manual)
+  int16_t param3;   // Third argument (beacon y)
+  bool hasParams;
+};
+
+class CommandInterface;
+
+// Registry entry: opcode, argument schema and handler
+struct CommandSpec {
+  char opcode;                                  // Text opcode (binary = opcode | 0x80)
+  CommandType type;
+  uint8_t minArgs;
+  uint8_t maxArgs;
+  void (CommandInterface::*handler)(const Command& cmd, const CommandSpec& spec);
+  void (MotorControl::*move)(uint8_t speed);    // Drive pattern for moves
+  void (MotorControl::*reverse)(uint8_t speed); // Pattern for negative amounts
+  int8_t motionKind;                            // MotionKind, or -1 if not modeled
+  int8_t sign;                                  // Odometry sign: -1 backward/left
+  const char* name;
+};
+
+// Last timed move, kept for motion model feedback
+struct MotionRecord {
+  MotionKind kind;
+  int8_t sign;        // +1 forward/right, -1 backward/left
+  uint8_t speed;
+  uint16_t durationMs;
+  unsigned long startTime;
+  bool valid;
+};
+
+class CommandInterface {
+public:
+  CommandInterface(MotorControl* motors, MotionModel* motion);
+
+  void begin();
+
+  // Parse a text or binary command
+  Command parse(const String& input);
+  Command parse(const uint8_t* data, size_t length);
+
+  // Execute a parsed command
+  void execute(const Command& cmd);
+
+  // Parse and execute in one step
+  void process(const String& input);
+  void process(const uint8_t* data, size_t length);
+
+  // Get status string for query response
+  String getStatus() const;
+
+  // Check timed moves
+  void update();
+
+  // Feed completed moves into a position estimator (optional)
+  void setPositionEstimator(PositionEstimator* position);
+
+  // Cancel timed moves and restore the default speed
+  void reset();
+
+  // Time source in ms (millis by default, virtual clock for replay)
+  void setClock(unsigned long (*clock)());
+
+  // Commands arrive on the BLE task and the loop task. process(),
+  // execute() and update() run under a recursive mutex; callers hold it
+  // with lock()/unlock() across process() and reading the response.
+  void lock();
+  void unlock();
+
+  // Response produced by the last query command
+  bool hasResponse() const;
+  const uint8_t* getResponse() const;
+  size_t getResponseLength() const;
+  void clearResponse();
+
+  // Command registry, see command_interface.cpp
+  static const CommandSpec commandTable[];
+  static const size_t commandCount;
+
+private:
+  MotorControl* motors;
+  MotionModel* motion;
+  PositionEstimator* position;
+  unsigned long (*clock)();
+  uint8_t defaultSpeed;
+  Command lastCommand;
+
+  unsigned long moveEndTime;
+  bool timedMoveActive;
+  MotionRecord lastMotion;
+
+  int16_t targetX;
+  int16_t targetY;
+  bool hasTarget;
+
+  uint8_t response[RESPONSE_MAX_LENGTH];
+  size_t responseLength;
+
+  // Serializes command state, the response and the position estimator
+  // (ranges from the BLE task, odometry from the loop task)
+  SemaphoreHandle_t mutex;
+
+  // Start a timed move and remember it for feedback
+  void startTimedMove(MotionKind kind, int8_t sign, uint8_t speed, uint16_t durationMs);
+
+  // End the active timed move and apply its odometry
+  void endTimedMove();
+
+  // Joystick mixing algorithm
+  void processJoystick(int16_t x, int16_t y);
+
+  // Shared argument decoding
+  static Command decode(const CommandSpec* spec, const int16_t* args, uint8_t argCount);
+  static Command parseText(const char* text, size_t length);
+  static Command parseBinary(const uint8_t* data, size_t length);
+
+  // Handlers
+  void handleTimedMove(const Command& cmd, const CommandSpec& spec);
+  void handleStop(const Command& cmd, const CommandSpec& spec);
+  void handlePhysicalMove(const Command& cmd, const CommandSpec& spec);
+  void handleFeedback(const Command& cmd, const CommandSpec& spec);
+  void handleManual(const Command& cmd, const CommandSpec& spec);
+  void handleJoystick(const Command& cmd, const CommandSpec& spec);
+  void handleSetSpeed(const Command& cmd, const CommandSpec& spec);
+  void handleQuery(const Command& cmd, const CommandSpec& spec);
+  void handleMetrics(const Command& cmd, const CommandSpec& spec);
+  void handleBeacon(const Command& cmd, const CommandSpec& spec);
+  void handleRange(const Command& cmd, const CommandSpec& spec);
+  void handleTarget(const Command& cmd, const CommandSpec& spec);
+  void handlePosition(const Command& cmd, const CommandSpec& spec);
+};
+
 #endif // COMMAND_INTERFACE_H
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*
+ * flight_recorder.cpp
+ * Flight recorder implementation
+ */
+
+#include "flight_recorder.h"
+#include <esp_system.h>
+
+#define FLIGHT_HEADER_SIZE  offsetof(FlightLog, records)
+
+// Not cleared by the startup code; validated through the magic
+RTC_NOINIT_ATTR static FlightLog flightLog;
+
+FlightRecorder flight;
+
+FlightRecorder::FlightRecorder()
+  : active(false), motorState{0}, lastSample(0), previousSize(0),
+    previousReason(0), previousValid(false) {
+}
+
+void FlightRecorder::begin() {
+  uint32_t reason = esp_reset_reason();
+
+  // After power-on the retained memory is random; any other reset
+  // leaves the previous run intact
+  if (reason != ESP_RST_POWERON &&
+      flightLog.magic == FLIGHT_MAGIC &&
+      flightLog.version == FLIGHT_VERSION &&
+      flightLog.recordSize == sizeof(FlightRecord)) {
+    preserve();
+    previousReason = reason;
+  }
+
+  reset(reason);
+
+  if (previousValid) {
+    Serial.printf("[Flight] Previous run ended by %s reset (%d records)\n",
+                  reasonName(previousReason), (int)previousSize);
+  } else {
+    Serial.printf("[Flight] Started after %s reset\n", reasonName(reason));
+  }
+}
+
+void FlightRecorder::reset(uint32_t reason) {
+  flightLog.magic = 0;
+  flightLog.next = 0;
+  for (size_t i = 0; i < FLIGHT_RECORDS; i++) {
+    flightLog.records[i].seq = 0;
+  }
+  flightLog.version = FLIGHT_VERSION;
+  flightLog.recordSize = sizeof(FlightRecord);
+  flightLog.resetReason = reason;
+  flightLog.magic = FLIGHT_MAGIC;
+  active = true;
+
+  write(FLIGHT_BOOT, (int16_t)reason, nullptr, 0);
+}
+
+void FlightRecorder::preserve() {
+  uint32_t next = flightLog.next;
+  uint32_t first = (next > FLIGHT_RECORDS) ? next - FLIGHT_RECORDS : 0;
+
+  // Copy in chronological order, skipping slots that were being
+  // written (or never written) when the reset hit
+  previousSize = 0;
+  for (uint32_t index = first; index < next; index++) {
+    const FlightRecord& record = flightLog.records[index & (FLIGHT_RECORDS - 1)];
+    if (record.seq != (uint16_t)(index + 1)) continue;
+    previous[previousSize++] = record;
+  }
+
+  // Mark the motor state the rover was in when it went down
+  for (size_t i = previousSize; i > 0; i--) {
+    if (previous[i - 1].type == FLIGHT_MOTOR) {
+      previous[i - 1].flags |= FLIGHT_FLAG_LAST_MOTOR;
+      break;
+    }
+  }
+
+  previousValid = true;
+}
+
+void FlightRecorder::write(uint8_t type, int16_t value, const uint8_t* data, size_t length) {
+  // Until begin() has preserved it, the ring still holds the previous run
+  if (!active) return;
+
+  // Claim a slot; concurrent writers get distinct indices
+  uint32_t index = __atomic_fetch_add(&flightLog.next, 1, __ATOMIC_RELAXED);
+  FlightRecord& record = flightLog.records[index & (FLIGHT_RECORDS - 1)];
+
+  record.seq = 0;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+  record.timeMs = millis();
+  record.type = type;
+  record.flags = 0;
+  record.value = value;
+  memset(record.data, 0, sizeof(record.data));
+  if (length > 0) {
+    memcpy(record.data, data, min(length, sizeof(record.data)));
+  }
+
+  // Publish last so a torn record never validates
+  __atomic_store_n(&record.seq, (uint16_t)(index + 1), __ATOMIC_RELEASE);
+}
+
+void FlightRecorder::update(unsigned long now) {
+  if (now - lastSample < FLIGHT_SAMPLE_INTERVAL_MS) return;
+  lastSample = now;
+
+  uint32_t millivolts = analogReadMilliVolts(VBAT_SENSE_PIN) * VBAT_DIVIDER_RATIO;
+  write(FLIGHT_SAMPLE, (int16_t)min(millivolts, (uint32_t)INT16_MAX), motorState, sizeof(motorState));
+}
+
+void FlightRecorder::recordCommand(uint8_t type, int16_t param1, int16_t param2, int16_t param3) {
+  uint8_t data[5] = {
+    type,
+    (uint8_t)(param2 & 0xFF), (uint8_t)((uint16_t)param2 >> 8),
+    (uint8_t)(param3 & 0xFF), (uint8_t)((uint16_t)param3 >> 8)
+  };
+  write(FLIGHT_COMMAND, param1, data, sizeof(data));
+}
+
+void FlightRecorder::recordMotor(uint8_t leftDir, uint8_t leftDuty, uint8_t rightDir, uint8_t rightDuty) {
+  motorState[0] = leftDir;
+  motorState[1] = leftDuty;
+  motorState[2] = rightDir;
+  motorState[3] = rightDuty;
+  write(FLIGHT_MOTOR, 0, motorState, sizeof(motorState));
+}
+
+bool FlightRecorder::hasPrevious() const {
+  return previousValid;
+}
+
+uint32_t FlightRecorder::previousResetReason() const {
+  return previousReason;
+}
+
+size_t FlightRecorder::previousCount() const {
+  return previousSize;
+}
+
+const char* FlightRecorder::reasonName(uint32_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:    return "POWERON";
+    case ESP_RST_EXT:        return "EXTERNAL";
+    case ESP_RST_SW:         return "SOFTWARE";
+    case ESP_RST_PANIC:      return "PANIC";
+    case ESP_RST_INT_WDT:    return "INT_WDT";
+    case ESP_RST_TASK_WDT:   return "TASK_WDT";
+    case ESP_RST_WDT:        return "WDT";
+    case ESP_RST_DEEPSLEEP:  return "DEEPSLEEP";
+    case ESP_RST_BROWNOUT:   return "BROWNOUT";
+    case ESP_RST_SDIO:       return "SDIO";
+    case ESP_RST_USB:        return "USB";
+    case ESP_RST_JTAG:       return "JTAG";
+    case ESP_RST_EFUSE:      return "EFUSE";
+    case ESP_RST_PWR_GLITCH: return "PWR_GLITCH";
+    case ESP_RST_CPU_LOCKUP: return "CPU_LOCKUP";
+    default:                 return "UNKNOWN";
+  }
+}
+
+void FlightRecorder::print() const {
+  if (!previousValid) {
+    Serial.println("[Flight] No previous run recorded");
+    return;
+  }
+
+  Serial.printf("[Flight] Previous run: %s reset, %d records\n",
+                reasonName(previousReason), (int)previousSize);
+
+  for (size_t i = previousSize; i > 0; i--) {
+    const FlightRecord& record = previous[i - 1];
+    if (record.flags & FLIGHT_FLAG_LAST_MOTOR) {
+      Serial.printf("[Flight] Last motor state at %lu ms: L:%d/%d R:%d/%d\n",
+                    (unsigned long)record.timeMs, record.data[0], record.data[1],
+                    record.data[2], record.data[3]);
+      break;
+    }
+  }
+
+  for (size_t i = previousSize; i > 0; i--) {
+    const FlightRecord& record = previous[i - 1];
+    if (record.type == FLIGHT_SAMPLE) {
+      Serial.printf("[Flight] Last supply sample at %lu ms: %d mV\n",
+                    (unsigned long)record.timeMs, record.value);
+      break;
+    }
+  }
+}
+
+void FlightRecorder::dump() const {
+  print();
+  for (size_t i = 0; i < previousSize; i++) {
+    const FlightRecord& record = previous[i];
+    Serial.printf("%lu %c %d", (unsigned long)record.timeMs, record.type, record.value);
+    for (uint8_t b = 0; b < sizeof(record.data); b++) {
+      Serial.printf(" %02X", record.data[b]);
+    }
+    Serial.println((record.flags & FLIGHT_FLAG_LAST_MOTOR) ? " <- last motor state" : "");
+  }
+}
+
+size_t FlightRecorder::byteSize() const {
+  return previousValid ? FLIGHT_HEADER_SIZE + previousSize * sizeof(FlightRecord) : 0;
+}
+
+size_t FlightRecorder::readBytes(uint32_t offset, uint8_t* buffer, size_t length) const {
+  size_t total = byteSize();
+  if (offset >= total) return 0;
+  length = min(length, (size_t)(total - offset));
+
+  // FlightLog header describing the preserved run
+  uint8_t header[FLIGHT_HEADER_SIZE];
+  uint32_t magic = FLIGHT_MAGIC;
+  uint16_t version = FLIGHT_VERSION;
+  uint16_t recordSize = sizeof(FlightRecord);
+  uint32_t count = previousSize;
+  memcpy(header + offsetof(FlightLog, magic), &magic, sizeof(magic));
+  memcpy(header + offsetof(FlightLog, version), &version, sizeof(version));
+  memcpy(header + offsetof(FlightLog, recordSize), &recordSize, sizeof(recordSize));
+  memcpy(header + offsetof(FlightLog, next), &count, sizeof(count));
+  memcpy(header + offsetof(FlightLog, resetReason), &previousReason, sizeof(previousReason));
+
+  size_t copied = 0;
+  if (offset < FLIGHT_HEADER_SIZE) {
+    copied = min(length, (size_t)(FLIGHT_HEADER_SIZE - offset));
+    memcpy(buffer, header + offset, copied);
+  }
+  if (copied < length) {
+    memcpy(buffer + copied,
+           (const uint8_t*)previous + (offset + copied - FLIGHT_HEADER_SIZE),
+           length - copied);
+  }
+  return length;
+}
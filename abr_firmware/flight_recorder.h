@@ -0,0 +1,122 @@
+/*
+ * flight_recorder.h
+ * Reset-surviving ring of commands, motor states and supply voltage
+ *
+ * The ring lives in RTC_NOINIT memory, which keeps its contents across
+ * brownout, watchdog and panic resets (but not power-on). Writers from
+ * the loop task and BLE callbacks claim a slot with an atomic increment
+ * and never block; a record is valid once its sequence number matches
+ * the slot, so a record torn by the reset itself is simply dropped.
+ *
+ * On boot, begin() checks the reset reason and, if the ring holds a
+ * previous run, copies it to RAM, flags the last motor state before the
+ * fault and starts a fresh ring. The preserved copy is what print(),
+ * dump() and the bulk stream return.
+ *
+ * Record types:
+ *   C  command: value = param1, data = opcode (0 = invalid), param2, param3
+ *   M  motor:   data = left dir, left duty, right dir, right duty
+ *   V  sample:  value = supply mV, data = current motor state
+ *   R  boot:    value = reset reason of this run
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <Arduino.h>
+#include <stddef.h>
+
+#define FLIGHT_MAGIC              0x46524543  // "FREC"
+#define FLIGHT_VERSION            1
+#define FLIGHT_RECORDS            256         // Power of two
+#define FLIGHT_SAMPLE_INTERVAL_MS 100
+
+// Supply voltage sense through a resistor divider (ADC-capable GPIO)
+#define VBAT_SENSE_PIN            0
+#define VBAT_DIVIDER_RATIO        2           // 100k/100k divider
+
+enum FlightRecordType : uint8_t {
+  FLIGHT_COMMAND = 'C',
+  FLIGHT_MOTOR   = 'M',
+  FLIGHT_SAMPLE  = 'V',
+  FLIGHT_BOOT    = 'R'
+};
+
+#define FLIGHT_FLAG_LAST_MOTOR    0x01        // Last motor state before the reset
+
+struct __attribute__((packed)) FlightRecord {
+  uint32_t timeMs;
+  uint16_t seq;                     // Low 16 bits of (slot index + 1), 0 = being written
+  uint8_t type;                     // FlightRecordType
+  uint8_t flags;
+  int16_t value;
+  uint8_t data[6];
+};
+
+struct FlightLog {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t next;                    // Total records claimed since the ring was reset
+  uint32_t resetReason;             // Reset reason of the run being recorded
+  FlightRecord records[FLIGHT_RECORDS];
+};
+
+// Layout is shared with the bulk stream and must survive firmware updates
+static_assert(sizeof(FlightRecord) == 16, "Flight record layout changed");
+static_assert(offsetof(FlightRecord, seq) == 4, "Flight record layout changed");
+static_assert(offsetof(FlightRecord, value) == 8, "Flight record layout changed");
+static_assert(offsetof(FlightRecord, data) == 10, "Flight record layout changed");
+static_assert(offsetof(FlightLog, records) == 16, "Flight log header layout changed");
+static_assert((FLIGHT_RECORDS & (FLIGHT_RECORDS - 1)) == 0, "Ring size must be a power of two");
+static_assert(65536 % FLIGHT_RECORDS == 0, "Sequence numbers must wrap with the ring");
+
+class FlightRecorder {
+public:
+  FlightRecorder();
+
+  // Preserve the previous run (if any) and start a new ring; call
+  // before anything records
+  void begin();
+
+  // Sample supply voltage every FLIGHT_SAMPLE_INTERVAL_MS
+  void update(unsigned long now);
+
+  void recordCommand(uint8_t type, int16_t param1, int16_t param2, int16_t param3);
+  void recordMotor(uint8_t leftDir, uint8_t leftDuty, uint8_t rightDir, uint8_t rightDuty);
+
+  // Previous run
+  bool hasPrevious() const;
+  uint32_t previousResetReason() const;
+  size_t previousCount() const;
+
+  // Summary and records of the previous run
+  void print() const;
+  void dump() const;
+
+  // Previous run as a FlightLog header followed by its valid records,
+  // for the bulk transfer channel; returns bytes copied
+  size_t byteSize() const;
+  size_t readBytes(uint32_t offset, uint8_t* buffer, size_t length) const;
+
+  // Printable name of an esp_reset_reason_t
+  static const char* reasonName(uint32_t reason);
+
+private:
+  bool active;
+  uint8_t motorState[4];
+  unsigned long lastSample;
+
+  FlightRecord previous[FLIGHT_RECORDS];
+  size_t previousSize;
+  uint32_t previousReason;
+  bool previousValid;
+
+  void write(uint8_t type, int16_t value, const uint8_t* data, size_t length);
+  void preserve();
+  void reset(uint32_t reason);
+};
+
+extern FlightRecorder flight;
+
+#endif // FLIGHT_RECORDER_H
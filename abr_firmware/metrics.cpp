@@ -0,0 +1,126 @@
+/*
+ * metrics.cpp
+ * Runtime metrics registry implementation
+ */
+
+#include "metrics.h"
+
+Metrics metrics;
+
+static const char* const COUNTER_NAMES[CTR_COUNT] = {
+  "ble_writes", "ble_errors", "serial_commands", "commands", "invalid_commands"
+};
+
+static const char* const GAUGE_NAMES[GAUGE_COUNT] = {
+  "heap_free", "heap_min", "serial_queue", "loop_stack_hwm", "ble_stack_hwm"
+};
+
+static const char* const HISTOGRAM_NAMES[HIST_COUNT] = {
+  "command_latency_us", "parse_us", "loop_period_us"
+};
+
+static uint8_t* putU32(uint8_t* p, uint32_t value) {
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+  p[2] = (value >> 16) & 0xFF;
+  p[3] = (value >> 24) & 0xFF;
+  return p + 4;
+}
+
+Metrics::Metrics()
+  : commandStartMicros{0}, commandPending{false},
+    bleTask(nullptr), lastSample(0) {
+  reset();
+}
+
+void Metrics::reset() {
+  memset(counters, 0, sizeof(counters));
+  memset(gauges, 0, sizeof(gauges));
+  memset(histograms, 0, sizeof(histograms));
+  memset(commandPending, 0, sizeof(commandPending));
+}
+
+void Metrics::setBleTask(TaskHandle_t task) {
+  bleTask = task;
+}
+
+void Metrics::sampleSystem(unsigned long now) {
+  if (now - lastSample < METRICS_SAMPLE_MS) return;
+  lastSample = now;
+
+  set(GAUGE_HEAP_FREE, ESP.getFreeHeap());
+  set(GAUGE_HEAP_MIN, ESP.getMinFreeHeap());
+  set(GAUGE_LOOP_STACK_HWM, uxTaskGetStackHighWaterMark(NULL));
+  if (bleTask != nullptr) {
+    set(GAUGE_BLE_STACK_HWM, uxTaskGetStackHighWaterMark(bleTask));
+  }
+}
+
+uint32_t Metrics::getCounter(CounterId id) const {
+  return counters[id];
+}
+
+uint32_t Metrics::getGauge(GaugeId id) const {
+  return gauges[id];
+}
+
+const Histogram& Metrics::getHistogram(HistogramId id) const {
+  return histograms[id];
+}
+
+size_t Metrics::snapshot(uint8_t* buffer, size_t capacity) const {
+  if (capacity < METRICS_SNAPSHOT_MAX) return 0;
+
+  uint8_t* p = buffer;
+  *p++ = METRICS_MAGIC;
+  *p++ = METRICS_VERSION;
+  *p++ = CTR_COUNT;
+  *p++ = GAUGE_COUNT;
+  *p++ = HIST_COUNT;
+  p = putU32(p, millis());
+
+  for (int i = 0; i < CTR_COUNT; i++) p = putU32(p, counters[i]);
+  for (int i = 0; i < GAUGE_COUNT; i++) p = putU32(p, gauges[i]);
+
+  for (int i = 0; i < HIST_COUNT; i++) {
+    const Histogram& h = histograms[i];
+    p = putU32(p, h.count);
+    p = putU32(p, h.max);
+
+    // Only send the non-empty bucket range
+    int first = 0;
+    int last = HISTOGRAM_BUCKETS - 1;
+    while (first < HISTOGRAM_BUCKETS && h.buckets[first] == 0) first++;
+    while (last >= first && h.buckets[last] == 0) last--;
+    uint8_t length = (first <= last) ? last - first + 1 : 0;
+
+    *p++ = (length > 0) ? first : 0;
+    *p++ = length;
+    for (int b = 0; b < length; b++) p = putU32(p, h.buckets[first + b]);
+  }
+
+  return p - buffer;
+}
+
+void Metrics::print() const {
+  Serial.println("[Metrics] Counters:");
+  for (int i = 0; i < CTR_COUNT; i++) {
+    Serial.printf("  %s = %lu\n", COUNTER_NAMES[i], (unsigned long)counters[i]);
+  }
+
+  Serial.println("[Metrics] Gauges:");
+  for (int i = 0; i < GAUGE_COUNT; i++) {
+    Serial.printf("  %s = %lu\n", GAUGE_NAMES[i], (unsigned long)gauges[i]);
+  }
+
+  Serial.println("[Metrics] Histograms:");
+  for (int i = 0; i < HIST_COUNT; i++) {
+    const Histogram& h = histograms[i];
+    Serial.printf("  %s count=%lu max=%lu\n", HISTOGRAM_NAMES[i],
+                  (unsigned long)h.count, (unsigned long)h.max);
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      if (h.buckets[b] == 0) continue;
+      Serial.printf("    < %lu: %lu\n", 1UL << b, (unsigned long)h.buckets[b]);
+    }
+  }
+}
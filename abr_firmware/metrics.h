@@ -0,0 +1,157 @@
+/*
+ * metrics.h
+ * Fixed-memory runtime metrics registry
+ *
+ * Counters, gauges and log2-bucketed histograms with static storage.
+ * Recording is inline and costs a handful of instructions, so it can
+ * be used from the control path, command parser and BLE callbacks.
+ * Updates from different tasks are not locked; an occasional lost
+ * increment is acceptable for diagnostics.
+ *
+ * Histogram bucket i counts values v with 2^(i-1) <= v < 2^i
+ * (bucket 0 counts v == 0, the last bucket also collects overflow).
+ *
+ * Binary snapshot (little-endian):
+ *   u8  magic 'M', u8 version
+ *   u8  counter count, u8 gauge count, u8 histogram count
+ *   u32 uptime ms
+ *   u32 counters[]
+ *   u32 gauges[]
+ *   per histogram:
+ *     u32 count, u32 max
+ *     u8  first non-empty bucket, u8 bucket run length
+ *     u32 buckets[run length]
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+#define METRICS_MAGIC         'M'
+#define METRICS_VERSION       1
+#define HISTOGRAM_BUCKETS     24      // Up to ~8.4 s in microseconds
+#define METRICS_SAMPLE_MS     1000    // System gauge sampling period
+
+enum CounterId {
+  CTR_BLE_WRITES,
+  CTR_BLE_ERRORS,
+  CTR_SERIAL_COMMANDS,
+  CTR_COMMANDS,
+  CTR_INVALID_COMMANDS,
+  CTR_COUNT
+};
+
+enum GaugeId {
+  GAUGE_HEAP_FREE,
+  GAUGE_HEAP_MIN,
+  GAUGE_SERIAL_QUEUE,
+  GAUGE_LOOP_STACK_HWM,
+  GAUGE_BLE_STACK_HWM,
+  GAUGE_COUNT
+};
+
+enum HistogramId {
+  HIST_COMMAND_LATENCY_US,  // Command received -> PWM applied
+  HIST_PARSE_US,            // Command parse time
+  HIST_LOOP_PERIOD_US,      // Main loop period
+  HIST_COUNT
+};
+
+// Task a command was received and executed on
+enum CommandSource {
+  SOURCE_LOOP,
+  SOURCE_BLE,
+  SOURCE_COUNT
+};
+
+struct Histogram {
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+};
+
+// Worst-case snapshot size
+#define METRICS_SNAPSHOT_MAX  (9 + 4 * (CTR_COUNT + GAUGE_COUNT) + \
+                               HIST_COUNT * (10 + 4 * HISTOGRAM_BUCKETS))
+
+class Metrics {
+public:
+  Metrics();
+
+  inline void increment(CounterId id, uint32_t n = 1) {
+    counters[id] += n;
+  }
+
+  inline void set(GaugeId id, uint32_t value) {
+    gauges[id] = value;
+  }
+
+  inline void record(HistogramId id, uint32_t value) {
+    Histogram& h = histograms[id];
+    uint8_t bucket = value ? 32 - __builtin_clz(value) : 0;
+    if (bucket >= HISTOGRAM_BUCKETS) bucket = HISTOGRAM_BUCKETS - 1;
+    h.buckets[bucket]++;
+    h.count++;
+    if (value > h.max) h.max = value;
+  }
+
+  // Command latency: mark when a command arrives, record when applied.
+  // The BLE callback task and the loop task (serial input, timed moves)
+  // each get their own pending slot, so a command arriving on one cannot
+  // overwrite the start time of one in flight on the other.
+  inline void markCommandStart() {
+    CommandSource source = currentSource();
+    commandStartMicros[source] = micros();
+    commandPending[source] = true;
+  }
+
+  inline void markActuated() {
+    CommandSource source = currentSource();
+    if (commandPending[source]) {
+      commandPending[source] = false;
+      record(HIST_COMMAND_LATENCY_US, micros() - commandStartMicros[source]);
+    }
+  }
+
+  inline void clearCommandStart() {
+    commandPending[currentSource()] = false;
+  }
+
+  // Remember the BLE callback task so its stack can be sampled
+  void setBleTask(TaskHandle_t task);
+
+  // Sample heap and stack gauges (call from the main loop)
+  void sampleSystem(unsigned long now);
+
+  uint32_t getCounter(CounterId id) const;
+  uint32_t getGauge(GaugeId id) const;
+  const Histogram& getHistogram(HistogramId id) const;
+
+  // Write a binary snapshot, returns bytes written (0 if it does not fit)
+  size_t snapshot(uint8_t* buffer, size_t capacity) const;
+
+  // Human-readable dump to Serial
+  void print() const;
+
+  void reset();
+
+private:
+  uint32_t counters[CTR_COUNT];
+  uint32_t gauges[GAUGE_COUNT];
+  Histogram histograms[HIST_COUNT];
+
+  uint32_t commandStartMicros[SOURCE_COUNT];
+  bool commandPending[SOURCE_COUNT];
+
+  TaskHandle_t bleTask;
+  unsigned long lastSample;
+
+  inline CommandSource currentSource() const {
+    return (bleTask != nullptr && xTaskGetCurrentTaskHandle() == bleTask) ? SOURCE_BLE : SOURCE_LOOP;
+  }
+};
+
+extern Metrics metrics;
+
+#endif // METRICS_H
@@ -0,0 +1,172 @@
+/*
+ * motion_model.cpp
+ * Online-calibrated motion model implementation
+ */
+
+#include "motion_model.h"
+#include <Preferences.h>
+
+MotionModel::MotionModel()
+  : dirty(false), dirtySince(0) {
+  loadDefaults();
+}
+
+void MotionModel::begin() {
+  Preferences prefs;
+  prefs.begin(MOTION_NVS_NAMESPACE, true);
+  size_t length = prefs.getBytesLength(MOTION_NVS_KEY);
+  bool loaded = false;
+  if (length == sizeof(table)) {
+    MotionTable stored;
+    prefs.getBytes(MOTION_NVS_KEY, &stored, sizeof(stored));
+    if (stored.version == MOTION_TABLE_VERSION) {
+      table = stored;
+      loaded = true;
+    }
+  }
+  prefs.end();
+
+  Serial.printf("[Motion] %s calibration table\n", loaded ? "Loaded" : "Default");
+}
+
+void MotionModel::update(unsigned long now) {
+  if (dirty && now - dirtySince >= MOTION_SAVE_DELAY_MS) {
+    save();
+  }
+}
+
+uint8_t MotionModel::levelIndex(uint8_t speed) {
+  if (speed <= MIN_SPEED) return 0;
+  uint8_t index = (speed - MIN_SPEED + MOTION_SPEED_STEP / 2) / MOTION_SPEED_STEP;
+  return min(index, (uint8_t)(MOTION_SPEED_LEVELS - 1));
+}
+
+uint8_t MotionModel::levelSpeed(uint8_t index) {
+  return MIN_SPEED + index * MOTION_SPEED_STEP;
+}
+
+void MotionModel::loadDefaults() {
+  memset(&table, 0, sizeof(table));
+  table.version = MOTION_TABLE_VERSION;
+
+  // Scale the reference rates proportionally to duty
+  for (uint8_t i = 0; i < MOTION_SPEED_LEVELS; i++) {
+    float speed = levelSpeed(i);
+    table.fits[MOTION_LINEAR][i].rate =
+      DEFAULT_LINEAR_RATE * speed / DEFAULT_LINEAR_SPEED;
+    table.fits[MOTION_ROTATION][i].rate =
+      DEFAULT_ROTATION_RATE * speed / DEFAULT_ROTATION_SPEED;
+  }
+}
+
+MotionPlan MotionModel::plan(MotionKind kind, int32_t amount, uint8_t speed) const {
+  uint8_t index = levelIndex(speed);
+  const MotionFit& fit = table.fits[kind][index];
+
+  MotionPlan result;
+  result.speed = levelSpeed(index);
+
+  // Nothing to do; do not turn D:0 into a minimum-length drive
+  if (amount == 0) {
+    result.durationMs = 0;
+    return result;
+  }
+
+  float target = abs(amount);
+  float duration = (target - fit.offset) / fit.rate;
+  duration = constrain(duration, MOTION_MIN_DURATION_MS, MOTION_MAX_DURATION_MS);
+  result.durationMs = (uint16_t)(duration + 0.5f);
+  return result;
+}
+
+float MotionModel::displacement(MotionKind kind, uint8_t speed, uint16_t durationMs) const {
+  const MotionFit& fit = table.fits[kind][levelIndex(speed)];
+  float result = fit.rate * durationMs + fit.offset;
+  return (result > 0) ? result : 0.0f;
+}
+
+float MotionModel::rate(MotionKind kind, uint8_t speed) const {
+  return table.fits[kind][levelIndex(speed)].rate;
+}
+
+void MotionModel::addObservation(MotionKind kind, uint8_t speed,
+                                 uint16_t durationMs, float observed) {
+  if (durationMs == 0 || observed < 0) return;
+
+  MotionFit& fit = table.fits[kind][levelIndex(speed)];
+  float t = durationMs;
+  float d = observed;
+
+  // Exponentially weighted sufficient statistics
+  fit.sumW = fit.sumW * MOTION_FORGETTING + 1.0f;
+  fit.sumT = fit.sumT * MOTION_FORGETTING + t;
+  fit.sumD = fit.sumD * MOTION_FORGETTING + d;
+  fit.sumTT = fit.sumTT * MOTION_FORGETTING + t * t;
+  fit.sumTD = fit.sumTD * MOTION_FORGETTING + t * d;
+  if (fit.samples < UINT16_MAX) fit.samples++;
+
+  float det = fit.sumW * fit.sumTT - fit.sumT * fit.sumT;
+  float rate;
+  float offset = fit.offset;
+
+  if (det > 1e-3f * fit.sumTT * fit.sumW) {
+    // Durations are spread enough to fit both rate and offset
+    rate = (fit.sumW * fit.sumTD - fit.sumT * fit.sumD) / det;
+    offset = (fit.sumD - rate * fit.sumT) / fit.sumW;
+  } else {
+    // Only one duration seen so far: refit the rate, keep the offset
+    rate = (fit.sumD - offset * fit.sumW) / fit.sumT;
+  }
+
+  // Reject degenerate fits (e.g. noisy feedback early on)
+  if (rate > 0 && fabsf(offset) < rate * MOTION_MAX_DURATION_MS) {
+    fit.rate = rate;
+    fit.offset = offset;
+  }
+
+  if (!dirty) {
+    dirty = true;
+    dirtySince = millis();
+  }
+
+  Serial.printf("[Motion] Observation %s speed=%d t=%dms -> %.1f (rate=%.4f offset=%.1f)\n",
+                kind == MOTION_LINEAR ? "linear" : "rotation",
+                speed, durationMs, observed, fit.rate, fit.offset);
+}
+
+void MotionModel::resetCalibration() {
+  loadDefaults();
+  save();
+}
+
+const MotionTable& MotionModel::getCalibration() const {
+  return table;
+}
+
+void MotionModel::setCalibration(const MotionTable& calibration) {
+  table = calibration;
+}
+
+void MotionModel::save() {
+  Preferences prefs;
+  prefs.begin(MOTION_NVS_NAMESPACE, false);
+  prefs.putBytes(MOTION_NVS_KEY, &table, sizeof(table));
+  prefs.end();
+  dirty = false;
+
+  Serial.println("[Motion] Calibration saved");
+}
+
+void MotionModel::print() const {
+  static const char* const units[MOTION_KIND_COUNT] = { "mm", "deg" };
+
+  for (uint8_t k = 0; k < MOTION_KIND_COUNT; k++) {
+    for (uint8_t i = 0; i < MOTION_SPEED_LEVELS; i++) {
+      const MotionFit& fit = table.fits[k][i];
+      Serial.printf("[Motion] %s speed=%d rate=%.4f %s/ms offset=%.1f %s (n=%d)\n",
+                    k == MOTION_LINEAR ? "linear  " : "rotation",
+                    levelSpeed(i), fit.rate, units[k], fit.offset, units[k],
+                    fit.samples);
+    }
+  }
+}
@@ -0,0 +1,116 @@
+/*
+ * motion_model.h
+ * Online-calibrated motion model for physical-unit moves
+ *
+ * Maps a distance (mm) or rotation (deg) at a speed level to a PWM duty
+ * and move duration. Each speed level keeps a linear model
+ *
+ *   displacement = rate * duration + offset
+ *
+ * where the offset absorbs spin-up dead time (negative) and coasting
+ * after the stop (positive). The model is
+ * refined incrementally from feedback (IMU yaw, encoders, beacon
+ * distance deltas or the K command) with an exponentially weighted
+ * least-squares fit, and the table is persisted in NVS.
+ */
+
+#ifndef MOTION_MODEL_H
+#define MOTION_MODEL_H
+
+#include <Arduino.h>
+#include "motor_control.h"
+
+// Speed levels spanning MIN_SPEED..MAX_SPEED
+#define MOTION_SPEED_LEVELS     6
+#define MOTION_SPEED_STEP       ((MAX_SPEED - MIN_SPEED) / (MOTION_SPEED_LEVELS - 1))
+
+// Default calibration (from the app's original timing constants)
+#define DEFAULT_LINEAR_SPEED    200     // 1000 ms per metre at speed 200
+#define DEFAULT_LINEAR_RATE     1.0f    // mm per ms
+#define DEFAULT_ROTATION_SPEED  185     // 850 ms per 90 deg at speed 185
+#define DEFAULT_ROTATION_RATE   (90.0f / 850.0f)  // deg per ms
+
+// Fitting
+#define MOTION_FORGETTING       0.9f    // Weight kept by older observations
+#define MOTION_MIN_DURATION_MS  20
+#define MOTION_MAX_DURATION_MS  15000
+
+// NVS persistence
+#define MOTION_NVS_NAMESPACE    "motion"
+#define MOTION_NVS_KEY          "cal"
+#define MOTION_TABLE_VERSION    1
+#define MOTION_SAVE_DELAY_MS    30000   // Batch writes to limit flash wear
+
+enum MotionKind {
+  MOTION_LINEAR,     // Millimetres
+  MOTION_ROTATION,   // Degrees
+  MOTION_KIND_COUNT
+};
+
+// Linear model plus weighted least-squares sufficient statistics
+struct MotionFit {
+  float rate;        // Units per ms
+  float offset;      // Units (negative = dead time)
+  float sumW;        // Sum of weights
+  float sumT;        // Sum of weighted durations
+  float sumD;        // Sum of weighted displacements
+  float sumTT;       // Sum of weighted duration^2
+  float sumTD;       // Sum of weighted duration * displacement
+  uint16_t samples;
+};
+
+struct MotionTable {
+  uint8_t version;
+  MotionFit fits[MOTION_KIND_COUNT][MOTION_SPEED_LEVELS];
+};
+
+// Result of planning a physical-unit move
+struct MotionPlan {
+  uint8_t speed;
+  uint16_t durationMs;
+};
+
+class MotionModel {
+public:
+  MotionModel();
+
+  // Load the calibration table from NVS (defaults if missing)
+  void begin();
+
+  // Persist pending calibration changes once they have settled
+  void update(unsigned long now);
+
+  // Plan a move of the given magnitude (mm or deg, sign ignored);
+  // zero yields a zero-duration plan
+  MotionPlan plan(MotionKind kind, int32_t amount, uint8_t speed) const;
+
+  // Expected magnitude of a move that ran for durationMs
+  float displacement(MotionKind kind, uint8_t speed, uint16_t durationMs) const;
+
+  // Steady-state speed at a duty (mm or deg per ms)
+  float rate(MotionKind kind, uint8_t speed) const;
+
+  // Feed back the observed magnitude of a move that ran for durationMs
+  void addObservation(MotionKind kind, uint8_t speed,
+                      uint16_t durationMs, float observed);
+
+  void resetCalibration();
+  void print() const;
+
+  // Whole calibration table, for session capture and replay;
+  // setCalibration() replaces it without persisting
+  const MotionTable& getCalibration() const;
+  void setCalibration(const MotionTable& calibration);
+
+private:
+  MotionTable table;
+  bool dirty;
+  unsigned long dirtySince;
+
+  static uint8_t levelIndex(uint8_t speed);
+  static uint8_t levelSpeed(uint8_t index);
+  void loadDefaults();
+  void save();
+};
+
+#endif // MOTION_MODEL_H
@@ -1,149 +1,280 @@
-/*
- * motor_control.cpp
- * Motor control implementation for L298N driver
- */
-
-#include "motor_control.h"
-
-MotorControl::MotorControl()
-  : currentSpeed(DEFAULT_SPEED), moving(false) {
-}
-
-void MotorControl::begin() {
-  // Configure direction pins
-  pinMode(IN1_PIN, OUTPUT);
-  pinMode(IN2_PIN, OUTPUT);
-  pinMode(IN3_PIN, OUTPUT);
-  pinMode(IN4_PIN, OUTPUT);
-
-  // Configure PWM pins
-  ledcAttach(ENA_PIN, PWM_FREQ, PWM_RESOLUTION);
-  ledcAttach(ENB_PIN, PWM_FREQ, PWM_RESOLUTION);
-
-  // Start stopped
-  stop();
-
-  Serial.println("[Motor] Initialized");
-}
-
-uint8_t MotorControl::constrainSpeed(uint8_t speed) {
-  if (speed == 0) return 0;
-  if (speed < MIN_SPEED) return MIN_SPEED;
-  if (speed > MAX_SPEED) return MAX_SPEED;
-  return speed;
-}
-
-void MotorControl::applyLeftMotor(Direction dir, uint8_t speed) {
-  speed = constrainSpeed(speed);
-
-  switch (dir) {
-    case DIR_FORWARD:
-      digitalWrite(IN1_PIN, HIGH);
-      digitalWrite(IN2_PIN, LOW);
-      ledcWrite(ENA_PIN, speed);
-      break;
-    case DIR_BACKWARD:
-      digitalWrite(IN1_PIN, LOW);
-      digitalWrite(IN2_PIN, HIGH);
-      ledcWrite(ENA_PIN, speed);
-      break;
-    case DIR_STOP:
-    default:
-      digitalWrite(IN1_PIN, LOW);
-      digitalWrite(IN2_PIN, LOW);
-      ledcWrite(ENA_PIN, 0);
-      break;
-  }
-}
-
-void MotorControl::applyRightMotor(Direction dir, uint8_t speed) {
-  speed = constrainSpeed(speed);
-
-  switch (dir) {
-    case DIR_FORWARD:
-      digitalWrite(IN3_PIN, HIGH);
-      digitalWrite(IN4_PIN, LOW);
-      ledcWrite(ENB_PIN, speed);
-      break;
-    case DIR_BACKWARD:
-      digitalWrite(IN3_PIN, LOW);
-      digitalWrite(IN4_PIN, HIGH);
-      ledcWrite(ENB_PIN, speed);
-      break;
-    case DIR_STOP:
-    default:
-      digitalWrite(IN3_PIN, LOW);
-      digitalWrite(IN4_PIN, LOW);
-      ledcWrite(ENB_PIN, 0);
-      break;
-  }
-}
-
-void MotorControl::setLeftMotor(Direction dir, uint8_t speed) {
-  applyLeftMotor(dir, speed);
-  moving = (dir != DIR_STOP);
-}
-
-void MotorControl::setRightMotor(Direction dir, uint8_t speed) {
-  applyRightMotor(dir, speed);
-  moving = (dir != DIR_STOP);
-}
-
-void MotorControl::setMotors(Direction leftDir, uint8_t leftSpeed,
-                              Direction rightDir, uint8_t rightSpeed) {
-  applyLeftMotor(leftDir, leftSpeed);
-  applyRightMotor(rightDir, rightSpeed);
-  moving = (leftDir != DIR_STOP) || (rightDir != DIR_STOP);
-}
-
-void MotorControl::forward(uint8_t speed) {
-  setMotors(DIR_FORWARD, speed, DIR_FORWARD, speed);
-  Serial.printf("[Motor] Forward @ %d\n", speed);
-}
-
-void MotorControl::backward(uint8_t speed) {
-  setMotors(DIR_BACKWARD, speed, DIR_BACKWARD, speed);
-  Serial.printf("[Motor] Backward @ %d\n", speed);
-}
-
-void MotorControl::turnLeft(uint8_t speed) {
-  // Left motor slower, right motor faster
-  setMotors(DIR_FORWARD, speed / 2, DIR_FORWARD, speed);
-  Serial.printf("[Motor] Turn Left @ %d\n", speed);
-}
-
-void MotorControl::turnRight(uint8_t speed) {
-  // Left motor faster, right motor slower
-  setMotors(DIR_FORWARD, speed, DIR_FORWARD, speed / 2);
-  Serial.printf("[Motor] Turn Right @ %d\n", speed);
-}
-
-void MotorControl::rotateLeft(uint8_t speed) {
-  // Spin in place: left backward, right forward
-  setMotors(DIR_BACKWARD, speed, DIR_FORWARD, speed);
-  Serial.printf("[Motor] Rotate Left @ %d\n", speed);
-}
-
-void MotorControl::rotateRight(uint8_t speed) {
-  // Spin in place: left forward, right backward
-  setMotors(DIR_FORWARD, speed, DIR_BACKWARD, speed);
-  Serial.printf("[Motor] Rotate Right @ %d\n", speed);
-}
-
-void MotorControl::stop() {
-  setMotors(DIR_STOP, 0, DIR_STOP, 0);
-  moving = false;
-  Serial.println("[Motor] Stop");
-}
-
-void MotorControl::setSpeed(uint8_t speed) {
-  currentSpeed = constrainSpeed(speed);
-}
-
-uint8_t MotorControl::getSpeed() const {
-  return currentSpeed;
-}
-
-bool MotorControl::isMoving() const {
-  return moving;
+/*
+ * motor_control.cpp
+ * Motor control implementation for L298N driver
+ */
+
+#include "motor_control.h"
+#include "metrics.h"
+#include "flight_recorder.h"
+#include "session_capture.h"
+
+MotorControl::MotorControl()
+  : currentSpeed(DEFAULT_SPEED), moving(false), asleep(false),
+    dryRun(false), outputObserver(nullptr), forwardGuard(nullptr),
+    motionGuard(nullptr), forwardDuty(0),
+    appliedLeftDir(DIR_STOP), appliedLeftDuty(0),
+    appliedRightDir(DIR_STOP), appliedRightDuty(0) {
+}
+
+void MotorControl::begin() {
+  // Configure direction pins
+  pinMode(IN1_PIN, OUTPUT);
+  pinMode(IN2_PIN, OUTPUT);
+  pinMode(IN3_PIN, OUTPUT);
+  pinMode(IN4_PIN, OUTPUT);
+
+  // Configure PWM pins
+  attachPwm();
+
+  // Start stopped
+  stop();
+
+  Serial.println("[Motor] Initialized");
+}
+
+void MotorControl::attachPwm() {
+  ledcAttach(ENA_PIN, PWM_FREQ, PWM_RESOLUTION);
+  ledcAttach(ENB_PIN, PWM_FREQ, PWM_RESOLUTION);
+}
+
+uint8_t MotorControl::constrainSpeed(uint8_t speed) {
+  if (speed == 0) return 0;
+  if (speed < MIN_SPEED) return MIN_SPEED;
+  if (speed > MAX_SPEED) return MAX_SPEED;
+  return speed;
+}
+
+uint8_t MotorControl::applyLeftMotor(Direction dir, uint8_t speed) {
+  speed = (dir == DIR_STOP) ? 0 : constrainSpeed(speed);
+  if (dryRun) return speed;
+
+  switch (dir) {
+    case DIR_FORWARD:
+      digitalWrite(IN1_PIN, HIGH);
+      digitalWrite(IN2_PIN, LOW);
+      ledcWrite(ENA_PIN, speed);
+      break;
+    case DIR_BACKWARD:
+      digitalWrite(IN1_PIN, LOW);
+      digitalWrite(IN2_PIN, HIGH);
+      ledcWrite(ENA_PIN, speed);
+      break;
+    case DIR_STOP:
+    default:
+      digitalWrite(IN1_PIN, LOW);
+      digitalWrite(IN2_PIN, LOW);
+      ledcWrite(ENA_PIN, 0);
+      break;
+  }
+  return speed;
+}
+
+uint8_t MotorControl::applyRightMotor(Direction dir, uint8_t speed) {
+  speed = (dir == DIR_STOP) ? 0 : constrainSpeed(speed);
+  if (dryRun) return speed;
+
+  switch (dir) {
+    case DIR_FORWARD:
+      digitalWrite(IN3_PIN, HIGH);
+      digitalWrite(IN4_PIN, LOW);
+      ledcWrite(ENB_PIN, speed);
+      break;
+    case DIR_BACKWARD:
+      digitalWrite(IN3_PIN, LOW);
+      digitalWrite(IN4_PIN, HIGH);
+      ledcWrite(ENB_PIN, speed);
+      break;
+    case DIR_STOP:
+    default:
+      digitalWrite(IN3_PIN, LOW);
+      digitalWrite(IN4_PIN, LOW);
+      ledcWrite(ENB_PIN, 0);
+      break;
+  }
+  return speed;
+}
+
+// One side at a time still goes through setMotors(), so the guards,
+// metrics and recorders see the combined output
+void MotorControl::setLeftMotor(Direction dir, uint8_t speed) {
+  setMotors(dir, speed, appliedRightDir, appliedRightDuty);
+}
+
+void MotorControl::setRightMotor(Direction dir, uint8_t speed) {
+  setMotors(appliedLeftDir, appliedLeftDuty, dir, speed);
+}
+
+void MotorControl::setMotors(Direction leftDir, uint8_t leftSpeed,
+                              Direction rightDir, uint8_t rightSpeed) {
+  if (asleep) {
+    if (leftDir == DIR_STOP && rightDir == DIR_STOP) {
+      return;  // Already released, nothing to drive
+    }
+    wake();
+  }
+
+  bool stopping = (leftDir == DIR_STOP && rightDir == DIR_STOP);
+  if (motionGuard != nullptr && !stopping && !motionGuard()) {
+    Serial.println("[Motor] Motion held during firmware update");
+    if (!dryRun) capture.recordEvent(CAPTURE_CAUSE_BLOCKED);
+    leftDir = DIR_STOP;
+    rightDir = DIR_STOP;
+  } else if (forwardGuard != nullptr && drivesForward(leftDir, rightDir) &&
+      !forwardGuard(constrainSpeed(max(leftSpeed, rightSpeed)))) {
+    Serial.println("[Motor] Forward blocked by obstacle");
+    if (!dryRun) capture.recordEvent(CAPTURE_CAUSE_BLOCKED);
+    leftDir = DIR_STOP;
+    rightDir = DIR_STOP;
+  }
+
+  uint8_t leftDuty = applyLeftMotor(leftDir, leftSpeed);
+  uint8_t rightDuty = applyRightMotor(rightDir, rightSpeed);
+  moving = (leftDir != DIR_STOP) || (rightDir != DIR_STOP);
+  forwardDuty = drivesForward(leftDir, rightDir) ? max(leftDuty, rightDuty) : 0;
+  appliedLeftDir = leftDir;
+  appliedLeftDuty = leftDuty;
+  appliedRightDir = rightDir;
+  appliedRightDuty = rightDuty;
+
+  if (!dryRun) {
+    metrics.markActuated();
+    flight.recordMotor(leftDir, leftDuty, rightDir, rightDuty);
+  }
+  if (outputObserver != nullptr) {
+    outputObserver(leftDir, leftDuty, rightDir, rightDuty);
+  }
+}
+
+void MotorControl::forward(uint8_t speed) {
+  setMotors(DIR_FORWARD, speed, DIR_FORWARD, speed);
+  Serial.printf("[Motor] Forward @ %d\n", speed);
+}
+
+void MotorControl::backward(uint8_t speed) {
+  setMotors(DIR_BACKWARD, speed, DIR_BACKWARD, speed);
+  Serial.printf("[Motor] Backward @ %d\n", speed);
+}
+
+void MotorControl::turnLeft(uint8_t speed) {
+  // Left motor slower, right motor faster
+  setMotors(DIR_FORWARD, speed / 2, DIR_FORWARD, speed);
+  Serial.printf("[Motor] Turn Left @ %d\n", speed);
+}
+
+void MotorControl::turnRight(uint8_t speed) {
+  // Left motor faster, right motor slower
+  setMotors(DIR_FORWARD, speed, DIR_FORWARD, speed / 2);
+  Serial.printf("[Motor] Turn Right @ %d\n", speed);
+}
+
+void MotorControl::rotateLeft(uint8_t speed) {
+  // Spin in place: left backward, right forward
+  setMotors(DIR_BACKWARD, speed, DIR_FORWARD, speed);
+  Serial.printf("[Motor] Rotate Left @ %d\n", speed);
+}
+
+void MotorControl::rotateRight(uint8_t speed) {
+  // Spin in place: left forward, right backward
+  setMotors(DIR_FORWARD, speed, DIR_BACKWARD, speed);
+  Serial.printf("[Motor] Rotate Right @ %d\n", speed);
+}
+
+void MotorControl::stop() {
+  setMotors(DIR_STOP, 0, DIR_STOP, 0);
+  moving = false;
+  Serial.println("[Motor] Stop");
+}
+
+void MotorControl::setSpeed(uint8_t speed) {
+  currentSpeed = constrainSpeed(speed);
+}
+
+uint8_t MotorControl::getSpeed() const {
+  return currentSpeed;
+}
+
+bool MotorControl::isMoving() const {
+  return moving;
+}
+
+void MotorControl::setDryRun(bool enabled) {
+  dryRun = enabled;
+}
+
+bool MotorControl::isDryRun() const {
+  return dryRun;
+}
+
+void MotorControl::setOutputObserver(MotorOutputObserver observer) {
+  outputObserver = observer;
+}
+
+void MotorControl::setForwardGuard(ForwardGuard guard) {
+  forwardGuard = guard;
+}
+
+ForwardGuard MotorControl::getForwardGuard() const {
+  return forwardGuard;
+}
+
+void MotorControl::setMotionGuard(MotionGuard guard) {
+  motionGuard = guard;
+}
+
+MotionGuard MotorControl::getMotionGuard() const {
+  return motionGuard;
+}
+
+bool MotorControl::drivesForward(Direction leftDir, Direction rightDir) const {
+  // Straight or arcing forward; spinning in place and reversing stay allowed
+  return (leftDir == DIR_FORWARD || rightDir == DIR_FORWARD) &&
+         leftDir != DIR_BACKWARD && rightDir != DIR_BACKWARD;
+}
+
+bool MotorControl::checkForwardGuard() {
+  if (forwardGuard == nullptr || forwardDuty == 0 || dryRun) return false;
+  if (forwardGuard(forwardDuty)) return false;
+
+  Serial.println("[Motor] Obstacle ahead - stopping");
+  capture.recordEvent(CAPTURE_CAUSE_OBSTACLE);
+  stop();
+  return true;
+}
+
+void MotorControl::sleep() {
+  if (asleep) return;
+
+  if (!dryRun) capture.recordEvent(CAPTURE_CAUSE_IDLE);
+  stop();
+
+  // Release PWM channels and hold enables low so the L298N draws
+  // only its quiescent current and LEDC no longer blocks light sleep
+  if (!dryRun) {
+    ledcDetach(ENA_PIN);
+    ledcDetach(ENB_PIN);
+    pinMode(ENA_PIN, OUTPUT);
+    pinMode(ENB_PIN, OUTPUT);
+    digitalWrite(ENA_PIN, LOW);
+    digitalWrite(ENB_PIN, LOW);
+  }
+
+  asleep = true;
+  Serial.println("[Motor] Sleep (PWM detached)");
+}
+
+void MotorControl::wake() {
+  if (!asleep) return;
+
+  if (!dryRun) {
+    attachPwm();
+    ledcWrite(ENA_PIN, 0);
+    ledcWrite(ENB_PIN, 0);
+  }
+
+  asleep = false;
+  Serial.println("[Motor] Wake (PWM attached)");
+}
+
+bool MotorControl::isAsleep() const {
+  return asleep;
 }
\ No newline at end of file
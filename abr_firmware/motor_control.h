@@ -1,82 +1,134 @@
-/*
-* motor_control.h
- * Motor control interface for L298N driver
- */
-
-#ifndef MOTOR_CONTROL_H
-#define MOTOR_CONTROL_H
-
-#include <Arduino.h>
-
-// Pin definitions
-#define ENA_PIN  6   // Left motor PWM (was ENB)
-#define IN1_PIN  4   // Left motor direction (was IN3)
-#define IN2_PIN  5   // Left motor direction (was IN4)
-#define IN3_PIN  15   // Right motor direction (was IN1)
-#define IN4_PIN  3  // Right motor direction (was IN2)
-#define ENB_PIN  2   // Right motor PWM (was ENA)
-
-// PWM settings
-
-#define PWM_FREQ       17000
-#define PWM_RESOLUTION 8      // 8-bit: 0-255
-
-// Speed settings
-#define MIN_SPEED     175     // Minimum speed that moves motors
-#define MAX_SPEED     240
-#define DEFAULT_SPEED 190
-
-// Motor identifiers
-enum Motor {
-    MOTOR_LEFT,
-    MOTOR_RIGHT,
-    MOTOR_BOTH
-  };
-
-// Direction identifiers
-enum Direction {
-    DIR_STOP,
-    DIR_FORWARD,
-    DIR_BACKWARD
-  };
-
-class MotorControl {
-public:
-    MotorControl();
-
-    void begin();
-
-    // Individual motor control
-    void setLeftMotor(Direction dir, uint8_t speed);
-    void setRightMotor(Direction dir, uint8_t speed);
-
-    // Combined control
-    void setMotors(Direction leftDir, uint8_t leftSpeed,
-                   Direction rightDir, uint8_t rightSpeed);
-
-    // Convenience functions
-    void forward(uint8_t speed = DEFAULT_SPEED);
-    void backward(uint8_t speed = DEFAULT_SPEED);
-    void turnLeft(uint8_t speed = DEFAULT_SPEED);
-    void turnRight(uint8_t speed = DEFAULT_SPEED);
-    void rotateLeft(uint8_t speed = DEFAULT_SPEED);   // Spin in place
-    void rotateRight(uint8_t speed = DEFAULT_SPEED);  // Spin in place
-    void stop();
-
-    // Speed adjustment
-    void setSpeed(uint8_t speed);
-    uint8_t getSpeed() const;
-
-    // Status
-    bool isMoving() const;
-
-private:
-    uint8_t currentSpeed;
-    bool moving;
-
-    uint8_t constrainSpeed(uint8_t speed);
-    void applyLeftMotor(Direction dir, uint8_t speed);
-    void applyRightMotor(Direction dir, uint8_t speed);
-};
-
+/*
+* motor_control.h
+ * Motor control interface for L298N driver
+ */
+
+#ifndef MOTOR_CONTROL_H
+#define MOTOR_CONTROL_H
+
+#include <Arduino.h>
+
+// Pin definitions
+#define ENA_PIN  6   // Left motor PWM (was ENB)
+#define IN1_PIN  4   // Left motor direction (was IN3)
+#define IN2_PIN  5   // Left motor direction (was IN4)
+#define IN3_PIN  15   // Right motor direction (was IN1)
+#define IN4_PIN  3  // Right motor direction (was IN2)
+#define ENB_PIN  2   // Right motor PWM (was ENA)
+
+// PWM settings
+
+#define PWM_FREQ       17000
+#define PWM_RESOLUTION 8      // 8-bit: 0-255
+
+// Speed settings
+#define MIN_SPEED     175     // Minimum speed that moves motors
+#define MAX_SPEED     240
+#define DEFAULT_SPEED 190
+
+// Motor identifiers
+enum Motor {
+    MOTOR_LEFT,
+    MOTOR_RIGHT,
+    MOTOR_BOTH
+  };
+
+// Direction identifiers
+enum Direction {
+    DIR_STOP,
+    DIR_FORWARD,
+    DIR_BACKWARD
+  };
+
+// Called with the applied direction and duty after every motor update
+typedef void (*MotorOutputObserver)(Direction leftDir, uint8_t leftDuty,
+                                    Direction rightDir, uint8_t rightDuty);
+
+// Returns false if driving forward at the given duty is unsafe
+typedef bool (*ForwardGuard)(uint8_t duty);
+
+// Returns false while the motors must stay stopped in any direction
+typedef bool (*MotionGuard)();
+
+class MotorControl {
+public:
+    MotorControl();
+
+    void begin();
+
+    // Individual motor control
+    void setLeftMotor(Direction dir, uint8_t speed);
+    void setRightMotor(Direction dir, uint8_t speed);
+
+    // Combined control
+    void setMotors(Direction leftDir, uint8_t leftSpeed,
+                   Direction rightDir, uint8_t rightSpeed);
+
+    // Convenience functions
+    void forward(uint8_t speed = DEFAULT_SPEED);
+    void backward(uint8_t speed = DEFAULT_SPEED);
+    void turnLeft(uint8_t speed = DEFAULT_SPEED);
+    void turnRight(uint8_t speed = DEFAULT_SPEED);
+    void rotateLeft(uint8_t speed = DEFAULT_SPEED);   // Spin in place
+    void rotateRight(uint8_t speed = DEFAULT_SPEED);  // Spin in place
+    void stop();
+
+    // Speed adjustment
+    void setSpeed(uint8_t speed);
+    uint8_t getSpeed() const;
+
+    // Status
+    bool isMoving() const;
+
+    // Power gating: detach PWM and release the H-bridge while idle.
+    // Any non-stop motor command re-attaches PWM automatically.
+    void sleep();
+    void wake();
+    bool isAsleep() const;
+
+    // Dry run: compute duties and notify the observer without touching
+    // GPIO/PWM (used for session replay). sleep()/wake() only track the
+    // state, and the motor guards still decide, so replay can install
+    // one that repeats the captured refusals.
+    void setDryRun(bool enabled);
+    bool isDryRun() const;
+
+    void setOutputObserver(MotorOutputObserver observer);
+
+    // Obstacle gating: forward commands the guard rejects are turned
+    // into a stop, and checkForwardGuard() re-checks a running forward
+    // move (call at loop rate). Returns true if it stopped the motors.
+    void setForwardGuard(ForwardGuard guard);
+    ForwardGuard getForwardGuard() const;
+    bool checkForwardGuard();
+
+    // Motion hold (firmware update): any command the guard rejects is
+    // turned into a stop
+    void setMotionGuard(MotionGuard guard);
+    MotionGuard getMotionGuard() const;
+
+private:
+    uint8_t currentSpeed;
+    bool moving;
+    bool asleep;
+    bool dryRun;
+    MotorOutputObserver outputObserver;
+    ForwardGuard forwardGuard;
+    MotionGuard motionGuard;
+    uint8_t forwardDuty;    // Duty of the current forward move, 0 if none
+
+    // Last applied output, kept for single-motor updates
+    Direction appliedLeftDir;
+    uint8_t appliedLeftDuty;
+    Direction appliedRightDir;
+    uint8_t appliedRightDuty;
+
+    void attachPwm();
+    bool drivesForward(Direction leftDir, Direction rightDir) const;
+
+    uint8_t constrainSpeed(uint8_t speed);
+    uint8_t applyLeftMotor(Direction dir, uint8_t speed);   // Returns applied duty
+    uint8_t applyRightMotor(Direction dir, uint8_t speed);
+};
+
 #endif // MOTOR_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,250 @@
+/*
+ * obstacle_sensor.cpp
+ * Ultrasonic ranging and obstacle guard implementation
+ */
+
+#include "obstacle_sensor.h"
+
+// Round trip at 343 m/s: mm per microsecond of echo pulse
+#define ULTRASONIC_MM_PER_US  0.1715f
+
+ObstacleSensor::ObstacleSensor(MotionModel* motion)
+  : motion(motion), sensorCount(0), nextSensor(0), lastTrigger(0),
+    blocked(false), blockReported(false), blockSensor(-1),
+    blockDistance(0), blockStopDistance(0),
+    eventCallback(nullptr) {
+}
+
+int ObstacleSensor::addSensor(uint8_t trigPin, uint8_t echoPin) {
+  if (sensorCount >= ULTRASONIC_MAX_SENSORS) return -1;
+
+  Sensor& sensor = sensors[sensorCount];
+  sensor.owner = this;
+  sensor.index = sensorCount;
+  sensor.trigPin = trigPin;
+  sensor.echoPin = echoPin;
+  sensor.riseUs = 0;
+  sensor.pulseUs = 0;
+  sensor.rising = false;
+  sensor.pulseReady = false;
+  sensor.sampleCount = 0;
+  sensor.filtered = ULTRASONIC_MAX_MM;
+  sensor.lastReading = 0;
+  sensor.valid = false;
+  sensor.online = false;
+  sensor.faulted = false;
+  return sensorCount++;
+}
+
+void ObstacleSensor::begin() {
+  for (uint8_t i = 0; i < sensorCount; i++) {
+    Sensor& sensor = sensors[i];
+    pinMode(sensor.trigPin, OUTPUT);
+    digitalWrite(sensor.trigPin, LOW);
+    pinMode(sensor.echoPin, INPUT);
+    attachInterruptArg(digitalPinToInterrupt(sensor.echoPin), echoIsr, &sensor, CHANGE);
+  }
+  Serial.printf("[Obstacle] %d ultrasonic sensor(s) initialized\n", sensorCount);
+}
+
+void IRAM_ATTR ObstacleSensor::echoIsr(void* arg) {
+  Sensor* sensor = (Sensor*)arg;
+  sensor->owner->onEchoEdge(sensor->index, digitalRead(sensor->echoPin), micros());
+}
+
+void IRAM_ATTR ObstacleSensor::onEchoEdge(uint8_t index, bool level, uint32_t timeUs) {
+  if (index >= sensorCount) return;
+  Sensor& sensor = sensors[index];
+
+  if (level) {
+    sensor.riseUs = timeUs;
+    sensor.rising = true;
+  } else if (sensor.rising) {
+    sensor.pulseUs = timeUs - sensor.riseUs;
+    sensor.rising = false;
+    sensor.pulseReady = true;
+  }
+}
+
+void ObstacleSensor::trigger(Sensor& sensor) {
+  sensor.rising = false;
+  digitalWrite(sensor.trigPin, HIGH);
+  delayMicroseconds(ULTRASONIC_TRIGGER_US);
+  digitalWrite(sensor.trigPin, LOW);
+}
+
+void ObstacleSensor::addSample(Sensor& sensor, float distance, unsigned long now) {
+  // Median of the last readings rejects single spurious echoes
+  if (sensor.sampleCount < ULTRASONIC_MEDIAN) {
+    sensor.samples[sensor.sampleCount++] = distance;
+  } else {
+    memmove(sensor.samples, sensor.samples + 1, (ULTRASONIC_MEDIAN - 1) * sizeof(float));
+    sensor.samples[ULTRASONIC_MEDIAN - 1] = distance;
+  }
+
+  float sorted[ULTRASONIC_MEDIAN];
+  memcpy(sorted, sensor.samples, sensor.sampleCount * sizeof(float));
+  for (uint8_t i = 1; i < sensor.sampleCount; i++) {
+    for (uint8_t j = i; j > 0 && sorted[j - 1] > sorted[j]; j--) {
+      float t = sorted[j];
+      sorted[j] = sorted[j - 1];
+      sorted[j - 1] = t;
+    }
+  }
+  float median = sorted[sensor.sampleCount / 2];
+
+  if (sensor.valid) {
+    sensor.filtered += ULTRASONIC_EMA_ALPHA * (median - sensor.filtered);
+  } else {
+    sensor.filtered = median;
+  }
+  sensor.lastReading = now;
+  sensor.valid = true;
+}
+
+void ObstacleSensor::update(unsigned long now) {
+  for (uint8_t i = 0; i < sensorCount; i++) {
+    Sensor& sensor = sensors[i];
+    if (!sensor.pulseReady) continue;
+    sensor.pulseReady = false;
+
+    uint32_t pulseUs = sensor.pulseUs;
+    float distance = pulseUs * ULTRASONIC_MM_PER_US;
+    if (pulseUs >= ULTRASONIC_ECHO_TIMEOUT_US || distance > ULTRASONIC_MAX_MM) {
+      distance = ULTRASONIC_MAX_MM;   // Nothing in range
+    } else if (distance < ULTRASONIC_MIN_MM) {
+      distance = ULTRASONIC_MIN_MM;   // Inside the blind zone
+    }
+    addSample(sensor, distance, now);
+  }
+
+  // One sensor at a time so they cannot hear each other's bursts
+  if (sensorCount > 0 && now - lastTrigger >= ULTRASONIC_PERIOD_MS) {
+    lastTrigger = now;
+    trigger(sensors[nextSensor]);
+    nextSensor = (nextSensor + 1) % sensorCount;
+  }
+
+  reportEvents(now);
+}
+
+void ObstacleSensor::reportEvents(unsigned long now) {
+  for (uint8_t i = 0; i < sensorCount; i++) {
+    Sensor& sensor = sensors[i];
+    if (!sensor.online) {
+      if (!sensor.valid) continue;      // Not fitted, or not heard yet
+      sensor.online = true;
+      sendEvent("OBS:ONLINE:" + String(i));
+    }
+
+    bool stale = now - sensor.lastReading > ULTRASONIC_STALE_MS;
+    if (stale) {
+      sensor.valid = false;
+      if (!sensor.faulted) {
+        sensor.faulted = true;
+        sendEvent("OBS:FAULT:" + String(i));
+      }
+    } else if (!stale) {
+      sensor.faulted = false;
+    }
+  }
+
+  if (blocked && !blockReported) {
+    blockReported = true;
+    if (blockSensor >= 0) {
+      sendEvent("OBS:BLOCKED:FAULT:" + String((int)blockSensor));
+    } else {
+      sendEvent("OBS:BLOCKED:" + String((int)blockDistance) + ":" +
+                String((int)blockStopDistance));
+    }
+  }
+
+  // Clear once every sensor reads again and the way ahead opens up
+  // beyond the last stopping distance
+  if (blocked && (OBSTACLE_FAIL_OPEN || faultedSensor() < 0) &&
+      nearestDistance() > blockStopDistance + OBSTACLE_CLEAR_HYSTERESIS) {
+    blocked = false;
+    blockReported = false;
+    sendEvent("OBS:CLEAR:" + String((int)nearestDistance()));
+  }
+}
+
+void ObstacleSensor::sendEvent(const String& event) {
+  Serial.printf("[Obstacle] %s\n", event.c_str());
+  if (eventCallback != nullptr) {
+    eventCallback(event);
+  }
+}
+
+float ObstacleSensor::getDistance(uint8_t sensor) const {
+  if (sensor >= sensorCount) return ULTRASONIC_MAX_MM;
+  return sensors[sensor].filtered;
+}
+
+bool ObstacleSensor::isValid(uint8_t sensor) const {
+  return sensor < sensorCount && sensors[sensor].valid;
+}
+
+float ObstacleSensor::nearestDistance() const {
+  float nearest = ULTRASONIC_MAX_MM;
+  for (uint8_t i = 0; i < sensorCount; i++) {
+    if (sensors[i].valid && sensors[i].filtered < nearest) {
+      nearest = sensors[i].filtered;
+    }
+  }
+  return nearest;
+}
+
+bool ObstacleSensor::isOnline(uint8_t sensor) const {
+  return sensor < sensorCount && sensors[sensor].online;
+}
+
+int ObstacleSensor::faultedSensor() const {
+  for (uint8_t i = 0; i < sensorCount; i++) {
+    if (sensors[i].online && !sensors[i].valid) return i;
+  }
+  return -1;
+}
+
+float ObstacleSensor::stoppingDistance(uint8_t duty) const {
+  float speed = motion->rate(MOTION_LINEAR, duty) * 1000.0f;  // mm/s
+  return speed * OBSTACLE_REACTION_MS / 1000.0f +
+         speed * speed / (2.0f * OBSTACLE_DECEL_MM_S2) +
+         OBSTACLE_MARGIN_MM;
+}
+
+bool ObstacleSensor::isClear(uint8_t duty) {
+  float nearest = nearestDistance();
+  float stop = stoppingDistance(duty);
+  int faulted = OBSTACLE_FAIL_OPEN ? -1 : faultedSensor();
+  if (faulted < 0 && nearest > stop) return true;
+
+  // Reported from update() on the loop task
+  if (!blocked) {
+    blockSensor = faulted;
+    blockDistance = nearest;
+    blockStopDistance = stop;
+    blocked = true;
+  }
+  return false;
+}
+
+void ObstacleSensor::setEventCallback(void (*callback)(const String& event)) {
+  eventCallback = callback;
+}
+
+void ObstacleSensor::print() const {
+  for (uint8_t i = 0; i < sensorCount; i++) {
+    const Sensor& sensor = sensors[i];
+    if (sensor.valid) {
+      Serial.printf("[Obstacle] Sensor %d: %.0f mm\n", i, sensor.filtered);
+    } else if (sensor.online) {
+      Serial.printf("[Obstacle] Sensor %d: no reading (blocking forward)\n", i);
+    } else {
+      Serial.printf("[Obstacle] Sensor %d: not heard since boot (not guarding)\n", i);
+    }
+  }
+  Serial.printf("[Obstacle] Stopping distance at speed %d: %.0f mm%s\n",
+                DEFAULT_SPEED, stoppingDistance(DEFAULT_SPEED),
+                blocked ? " (blocked)" : "");
+}
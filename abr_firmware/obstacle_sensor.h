@@ -0,0 +1,141 @@
+/*
+ * obstacle_sensor.h
+ * Interrupt-driven ultrasonic ranging (HC-SR04) and forward obstacle guard
+ *
+ * Each sensor is triggered in turn from update(); the echo pulse is
+ * timed by a CHANGE interrupt on the echo pin, so nothing blocks on
+ * pulseIn(). Edges go through onEchoEdge(), which also takes injected
+ * timestamps for bench/host testing. Distances are median-of-3 then
+ * EMA filtered.
+ *
+ * All sensors face forward. isClear() compares the nearest distance with
+ * the stopping distance at the commanded duty,
+ *
+ *   d_stop = v * t_react + v^2 / (2 * a) + margin
+ *
+ * with v taken from the calibrated motion model, and is installed as the
+ * MotorControl forward guard. A sensor starts guarding with its first
+ * reading since boot, so a rover without one fitted still drives forward.
+ * From then on, a sensor without a reading for ULTRASONIC_STALE_MS is
+ * faulted and blocks forward motion until it reports again: the guard
+ * fails closed.
+ * Reversing and turning on the spot stay available. Building with
+ * OBSTACLE_FAIL_OPEN 1 lets forward motion through on a fault instead,
+ * guarded by the remaining sensors only.
+ *
+ * Events (status characteristic):
+ *   OBS:ONLINE:<sensor>
+ *   OBS:BLOCKED:<distance mm>:<stopping distance mm>
+ *   OBS:BLOCKED:FAULT:<sensor>
+ *   OBS:CLEAR:<distance mm>
+ *   OBS:FAULT:<sensor>
+ */
+
+#ifndef OBSTACLE_SENSOR_H
+#define OBSTACLE_SENSOR_H
+
+#include <Arduino.h>
+#include "motion_model.h"
+
+// Front sensor pins (echo through a 5V -> 3.3V divider)
+#define ULTRASONIC_TRIG_PIN         18
+#define ULTRASONIC_ECHO_PIN         19
+
+#define ULTRASONIC_MAX_SENSORS      2
+#define ULTRASONIC_PERIOD_MS        40      // Between triggers (all sensors)
+#define ULTRASONIC_TRIGGER_US       10
+#define ULTRASONIC_ECHO_TIMEOUT_US  25000   // Longer pulses mean no echo
+#define ULTRASONIC_MIN_MM           20
+#define ULTRASONIC_MAX_MM           4000
+#define ULTRASONIC_MEDIAN           3
+#define ULTRASONIC_EMA_ALPHA        0.5f
+#define ULTRASONIC_STALE_MS         250     // No reading for this long = fault
+
+// Stopping distance model
+#define OBSTACLE_REACTION_MS        120     // Sensor period, filter lag, loop tick
+#define OBSTACLE_DECEL_MM_S2        2000.0f // Braking deceleration
+#define OBSTACLE_MARGIN_MM          50
+#define OBSTACLE_CLEAR_HYSTERESIS   50      // mm beyond the stop distance to clear
+#define OBSTACLE_FAIL_OPEN          0       // 1 = faulted sensors do not block
+
+class ObstacleSensor {
+public:
+  ObstacleSensor(MotionModel* motion);
+
+  // Register a sensor before begin(); returns its index or -1
+  int addSensor(uint8_t trigPin, uint8_t echoPin);
+
+  void begin();
+
+  // Trigger the next sensor and filter finished echoes; call at loop rate
+  void update(unsigned long now);
+
+  // Echo pin edge (ISR context); level is the pin state after the edge
+  void onEchoEdge(uint8_t sensor, bool level, uint32_t timeUs);
+
+  // Filtered distance in mm (ULTRASONIC_MAX_MM when nothing in range)
+  float getDistance(uint8_t sensor) const;
+  bool isValid(uint8_t sensor) const;
+  float nearestDistance() const;
+
+  // A reading arrived since boot, so the sensor guards
+  bool isOnline(uint8_t sensor) const;
+
+  // First online sensor without a fresh reading, or -1
+  int faultedSensor() const;
+
+  // Forward guard: true if the rover can still stop in time at this duty
+  bool isClear(uint8_t duty);
+  float stoppingDistance(uint8_t duty) const;
+
+  void setEventCallback(void (*callback)(const String& event));
+
+  void print() const;
+
+private:
+  struct Sensor {
+    ObstacleSensor* owner;
+    uint8_t index;
+    uint8_t trigPin;
+    uint8_t echoPin;
+
+    // Written by the echo ISR
+    volatile uint32_t riseUs;
+    volatile uint32_t pulseUs;
+    volatile bool rising;
+    volatile bool pulseReady;
+
+    float samples[ULTRASONIC_MEDIAN];
+    uint8_t sampleCount;
+    float filtered;
+    unsigned long lastReading;
+    bool valid;
+    bool online;                      // Has read since boot
+    bool faulted;
+  };
+
+  MotionModel* motion;
+
+  Sensor sensors[ULTRASONIC_MAX_SENSORS];
+  uint8_t sensorCount;
+  uint8_t nextSensor;
+  unsigned long lastTrigger;
+
+  // Guard state, set from whichever task commands the motors
+  volatile bool blocked;
+  volatile bool blockReported;
+  volatile int8_t blockSensor;        // Faulted sensor that blocked, or -1
+  volatile float blockDistance;
+  volatile float blockStopDistance;
+
+  void (*eventCallback)(const String& event);
+
+  void addSample(Sensor& sensor, float distance, unsigned long now);
+  void trigger(Sensor& sensor);
+  void reportEvents(unsigned long now);
+  void sendEvent(const String& event);
+
+  static void echoIsr(void* arg);
+};
+
+#endif // OBSTACLE_SENSOR_H
@@ -0,0 +1,290 @@
+/*
+ * position_estimator.cpp
+ * Multi-beacon EKF implementation
+ */
+
+#include "position_estimator.h"
+#include <math.h>
+#include <string.h>
+
+#define POSITION_PI               3.14159265f
+#define POSITION_INITIAL_HEADING_VAR  (POSITION_PI * POSITION_PI)
+
+PositionEstimator::PositionEstimator()
+  : valid(false), updateCount(0), rejectCount(0) {
+  clearBeacons();
+  reset();
+}
+
+bool PositionEstimator::setBeacon(uint16_t id, float x, float y,
+                                  float txPower, float pathLoss) {
+  BeaconAnchor* beacon = findBeacon(id);
+  if (beacon == nullptr) {
+    for (size_t i = 0; i < POSITION_MAX_BEACONS; i++) {
+      if (!beacons[i].active) {
+        beacon = &beacons[i];
+        break;
+      }
+    }
+  }
+  if (beacon == nullptr) return false;
+
+  beacon->id = id;
+  beacon->x = x;
+  beacon->y = y;
+  beacon->txPower = txPower;
+  beacon->pathLoss = pathLoss;
+  beacon->lastRange = -1.0f;
+  beacon->lastVariance = 0.0f;
+  beacon->active = true;
+  return true;
+}
+
+void PositionEstimator::clearBeacons() {
+  memset(beacons, 0, sizeof(beacons));
+}
+
+size_t PositionEstimator::beaconCount() const {
+  size_t count = 0;
+  for (size_t i = 0; i < POSITION_MAX_BEACONS; i++) {
+    if (beacons[i].active) count++;
+  }
+  return count;
+}
+
+void PositionEstimator::reset() {
+  memset(state, 0, sizeof(state));
+  memset(cov, 0, sizeof(cov));
+  valid = false;
+  for (size_t i = 0; i < POSITION_MAX_BEACONS; i++) {
+    beacons[i].lastRange = -1.0f;
+  }
+}
+
+BeaconAnchor* PositionEstimator::findBeacon(uint16_t id) {
+  for (size_t i = 0; i < POSITION_MAX_BEACONS; i++) {
+    if (beacons[i].active && beacons[i].id == id) return &beacons[i];
+  }
+  return nullptr;
+}
+
+float PositionEstimator::wrapAngle(float angle) {
+  while (angle > POSITION_PI) angle -= 2.0f * POSITION_PI;
+  while (angle <= -POSITION_PI) angle += 2.0f * POSITION_PI;
+  return angle;
+}
+
+float PositionEstimator::rssiToRange(float rssi, float txPower, float pathLoss) {
+  // Log-distance path loss: rssi = txPower - 10 n log10(d / 1 m)
+  return 1000.0f * powf(10.0f, (txPower - rssi) / (10.0f * pathLoss));
+}
+
+void PositionEstimator::predict(float distance, float rotation) {
+  if (!valid) return;
+
+  float heading = state[2];
+  float c = cosf(heading);
+  float s = sinf(heading);
+
+  state[0] += distance * c;
+  state[1] += distance * s;
+  state[2] = wrapAngle(heading + rotation);
+
+  // P = F P F^T + G Q G^T with F = I + d * dpos/dheading
+  float f02 = -distance * s;
+  float f12 = distance * c;
+
+  float p[3][3];
+  memcpy(p, cov, sizeof(p));
+
+  // F P
+  float fp[3][3];
+  for (int j = 0; j < 3; j++) {
+    fp[0][j] = p[0][j] + f02 * p[2][j];
+    fp[1][j] = p[1][j] + f12 * p[2][j];
+    fp[2][j] = p[2][j];
+  }
+  // (F P) F^T
+  for (int i = 0; i < 3; i++) {
+    cov[i][0] = fp[i][0] + fp[i][2] * f02;
+    cov[i][1] = fp[i][1] + fp[i][2] * f12;
+    cov[i][2] = fp[i][2];
+  }
+
+  // Odometry noise along the direction of travel and in heading
+  float distanceVar = POSITION_DISTANCE_NOISE * distance;
+  distanceVar *= distanceVar;
+  float rotationStd = POSITION_ROTATION_NOISE * fabsf(rotation) + POSITION_ROTATION_FLOOR;
+
+  cov[0][0] += distanceVar * c * c;
+  cov[0][1] += distanceVar * c * s;
+  cov[1][0] += distanceVar * c * s;
+  cov[1][1] += distanceVar * s * s;
+  cov[2][2] += rotationStd * rotationStd;
+}
+
+bool PositionEstimator::updateRssi(uint16_t id, float rssi) {
+  BeaconAnchor* beacon = findBeacon(id);
+  if (beacon == nullptr) return false;
+
+  float range = rssiToRange(rssi, beacon->txPower, beacon->pathLoss);
+
+  // Propagate RSSI noise: dd/drssi = d ln(10) / (10 n)
+  float rangeStd = range * 2.302585f / (10.0f * beacon->pathLoss) * POSITION_RSSI_STDDEV_DB;
+  return updateRange(id, range, rangeStd * rangeStd);
+}
+
+bool PositionEstimator::updateRange(uint16_t id, float range, float variance) {
+  BeaconAnchor* beacon = findBeacon(id);
+  if (beacon == nullptr || range <= 0 || range > POSITION_MAX_RANGE_MM) {
+    rejectCount++;
+    return false;
+  }
+
+  beacon->lastRange = range;
+  beacon->lastVariance = variance;
+
+  if (!valid) {
+    return initialize();
+  }
+
+  float dx = state[0] - beacon->x;
+  float dy = state[1] - beacon->y;
+  float predicted = sqrtf(dx * dx + dy * dy);
+  if (predicted < 1.0f) predicted = 1.0f;
+
+  // H = [dx/r, dy/r, 0]
+  float h0 = dx / predicted;
+  float h1 = dy / predicted;
+
+  // P H^T
+  float ph[3];
+  for (int i = 0; i < 3; i++) {
+    ph[i] = cov[i][0] * h0 + cov[i][1] * h1;
+  }
+
+  float innovation = range - predicted;
+  float innovationVar = h0 * ph[0] + h1 * ph[1] + variance;
+
+  // Outlier gate
+  if (innovation * innovation > POSITION_GATE_SIGMA2 * innovationVar) {
+    rejectCount++;
+    return false;
+  }
+
+  float gain[3];
+  for (int i = 0; i < 3; i++) {
+    gain[i] = ph[i] / innovationVar;
+    state[i] += gain[i] * innovation;
+  }
+  state[2] = wrapAngle(state[2]);
+
+  // P = P - K (H P), kept symmetric
+  for (int i = 0; i < 3; i++) {
+    for (int j = i; j < 3; j++) {
+      float value = cov[i][j] - gain[i] * ph[j];
+      cov[i][j] = value;
+      cov[j][i] = value;
+    }
+  }
+
+  updateCount++;
+  return true;
+}
+
+bool PositionEstimator::initialize() {
+  // Linearized trilateration against the first ranged beacon:
+  // 2 (bi - b0) . p = r0^2 - ri^2 + |bi|^2 - |b0|^2
+  const BeaconAnchor* ranged[POSITION_MAX_BEACONS];
+  size_t count = 0;
+  for (size_t i = 0; i < POSITION_MAX_BEACONS; i++) {
+    if (beacons[i].active && beacons[i].lastRange > 0) {
+      ranged[count++] = &beacons[i];
+    }
+  }
+  if (count < POSITION_MIN_BEACONS) return false;
+
+  const BeaconAnchor* ref = ranged[0];
+  float refNorm = ref->x * ref->x + ref->y * ref->y;
+
+  // Weighted normal equations A^T W A p = A^T W b
+  float a00 = 0, a01 = 0, a11 = 0, b0 = 0, b1 = 0;
+  for (size_t i = 1; i < count; i++) {
+    const BeaconAnchor* beacon = ranged[i];
+    float ax = 2.0f * (beacon->x - ref->x);
+    float ay = 2.0f * (beacon->y - ref->y);
+    float rhs = ref->lastRange * ref->lastRange - beacon->lastRange * beacon->lastRange
+              + beacon->x * beacon->x + beacon->y * beacon->y - refNorm;
+
+    // Squared-range noise grows with range: var(r^2) ~ 4 r^2 var(r)
+    float weight = 1.0f / (4.0f * (beacon->lastRange * beacon->lastRange * beacon->lastVariance
+                                  + ref->lastRange * ref->lastRange * ref->lastVariance) + 1.0f);
+
+    a00 += weight * ax * ax;
+    a01 += weight * ax * ay;
+    a11 += weight * ay * ay;
+    b0 += weight * ax * rhs;
+    b1 += weight * ay * rhs;
+  }
+
+  float det = a00 * a11 - a01 * a01;
+  if (det <= 1e-6f * a00 * a11) return false;  // Beacons are collinear
+
+  state[0] = (a11 * b0 - a01 * b1) / det;
+  state[1] = (a00 * b1 - a01 * b0) / det;
+  state[2] = 0.0f;
+
+  // Position covariance from the normal matrix inverse, heading unknown
+  memset(cov, 0, sizeof(cov));
+  cov[0][0] = a11 / det;
+  cov[0][1] = -a01 / det;
+  cov[1][0] = -a01 / det;
+  cov[1][1] = a00 / det;
+  cov[2][2] = POSITION_INITIAL_HEADING_VAR;
+
+  valid = true;
+  updateCount++;
+  return true;
+}
+
+bool PositionEstimator::isValid() const {
+  return valid;
+}
+
+float PositionEstimator::getX() const {
+  return state[0];
+}
+
+float PositionEstimator::getY() const {
+  return state[1];
+}
+
+float PositionEstimator::getHeading() const {
+  return state[2];
+}
+
+float PositionEstimator::getPositionStdDev() const {
+  return sqrtf(cov[0][0] + cov[1][1]);
+}
+
+float PositionEstimator::getHeadingStdDev() const {
+  return sqrtf(cov[2][2]);
+}
+
+float PositionEstimator::distanceTo(float x, float y) const {
+  float dx = x - state[0];
+  float dy = y - state[1];
+  return sqrtf(dx * dx + dy * dy);
+}
+
+float PositionEstimator::bearingTo(float x, float y) const {
+  return wrapAngle(atan2f(y - state[1], x - state[0]) - state[2]);
+}
+
+uint32_t PositionEstimator::getUpdateCount() const {
+  return updateCount;
+}
+
+uint32_t PositionEstimator::getRejectCount() const {
+  return rejectCount;
+}
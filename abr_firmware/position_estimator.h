@@ -0,0 +1,114 @@
+/*
+ * position_estimator.h
+ * Multi-beacon 2D position and heading estimator
+ *
+ * Portable C++ (no Arduino dependencies) so the same code runs in the
+ * firmware and in a host simulator.
+ *
+ * An extended Kalman filter tracks the state [x, y, heading]:
+ *   - predict() applies odometry from the motion model (drive along the
+ *     current heading, then rotate)
+ *   - updateRssi()/updateRange() fuse one ranging sample per call
+ *
+ * The filter starts once three or more beacons have been ranged, using
+ * a weighted least-squares trilateration fix. Heading starts unknown
+ * (0 with variance pi^2) and becomes observable as the rover moves. All
+ * storage is fixed-size; no update allocates.
+ *
+ * Expected accuracy with RSSI ranging is coarse: with four beacons on a
+ * 5 m square and 4 dB noise, test/bench_position_estimator measures a
+ * mean error of about 0.6 m and 30 deg while driving, against about
+ * 2.5 m for trilaterating each round of samples alone. The gate is
+ * 4 sigma because range errors from RSSI are skewed long.
+ *
+ * Units: millimetres and radians, heading counter-clockwise from +x.
+ */
+
+#ifndef POSITION_ESTIMATOR_H
+#define POSITION_ESTIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POSITION_MAX_BEACONS        8
+#define POSITION_MIN_BEACONS        3
+
+// Log-distance path loss defaults (RSSI at 1 m, exponent)
+#define POSITION_DEFAULT_TX_POWER   -59.0f
+#define POSITION_DEFAULT_PATH_LOSS  2.0f
+#define POSITION_RSSI_STDDEV_DB     4.0f
+
+// Filter tuning
+#define POSITION_DISTANCE_NOISE     0.10f   // Odometry stddev per mm driven
+#define POSITION_ROTATION_NOISE     0.10f   // Odometry stddev per rad turned
+#define POSITION_ROTATION_FLOOR     0.02f   // Heading noise added per move (rad)
+#define POSITION_GATE_SIGMA2        16.0f   // Reject innovations beyond 4 sigma
+#define POSITION_MAX_RANGE_MM       30000.0f
+
+struct BeaconAnchor {
+  uint16_t id;
+  float x;                  // mm
+  float y;                  // mm
+  float txPower;            // RSSI at 1 m (dBm)
+  float pathLoss;           // Path loss exponent
+  float lastRange;          // Most recent range (mm), < 0 if none
+  float lastVariance;
+  bool active;
+};
+
+class PositionEstimator {
+public:
+  PositionEstimator();
+
+  // Beacon configuration
+  bool setBeacon(uint16_t id, float x, float y,
+                 float txPower = POSITION_DEFAULT_TX_POWER,
+                 float pathLoss = POSITION_DEFAULT_PATH_LOSS);
+  void clearBeacons();
+  size_t beaconCount() const;
+
+  // Forget the estimate (beacons are kept)
+  void reset();
+
+  // Odometry: drive distance (mm, negative = backward), then rotate (rad, CCW)
+  void predict(float distance, float rotation);
+
+  // Fuse one sample; false if the beacon is unknown or the sample was rejected
+  bool updateRssi(uint16_t id, float rssi);
+  bool updateRange(uint16_t id, float range, float variance);
+
+  // Estimate
+  bool isValid() const;
+  float getX() const;
+  float getY() const;
+  float getHeading() const;                 // (-pi, pi]
+  float getPositionStdDev() const;          // mm, from covariance trace
+  float getHeadingStdDev() const;           // rad
+
+  // Navigation outputs, relative to the current estimate
+  float distanceTo(float x, float y) const;
+  float bearingTo(float x, float y) const;  // rad, positive = turn left (CCW)
+
+  // Diagnostics
+  uint32_t getUpdateCount() const;
+  uint32_t getRejectCount() const;
+
+  // RSSI to range with the beacon's path loss model
+  static float rssiToRange(float rssi, float txPower, float pathLoss);
+
+private:
+  BeaconAnchor beacons[POSITION_MAX_BEACONS];
+
+  float state[3];           // x, y, heading
+  float cov[3][3];
+  bool valid;
+
+  uint32_t updateCount;
+  uint32_t rejectCount;
+
+  BeaconAnchor* findBeacon(uint16_t id);
+  bool initialize();
+  static float wrapAngle(float angle);
+};
+
+#endif // POSITION_ESTIMATOR_H
@@ -0,0 +1,160 @@
+/*
+ * power_manager.cpp
+ * Idle power management implementation
+ */
+
+#include "power_manager.h"
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <driver/uart.h>
+
+static const unsigned long BUCKET_CURRENT_MA[BUCKET_COUNT] = {
+  CURRENT_MOVING_MA,
+  CURRENT_STOPPED_MA,
+  CURRENT_IDLE_MA
+};
+
+PowerManager::PowerManager(MotorControl* motors, BLEManager* ble)
+  : motors(motors), ble(ble),
+    state(POWER_ACTIVE),
+    idleTimeout(DEFAULT_IDLE_TIMEOUT_MS),
+    lastActivity(0), activityPending(false), lastUpdate(0),
+    timeInBucket{0}, chargeMilliAmpMs(0), idleEntries(0) {
+}
+
+void PowerManager::begin(unsigned long now) {
+  lastActivity = now;
+  lastUpdate = now;
+
+  // Let UART RX edges wake the chip from light sleep. The characters
+  // that trigger the wakeup are consumed by the UART wakeup logic.
+  uart_set_wakeup_threshold(UART_NUM_0, 3);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+
+  Serial.printf("[Power] Initialized (idle after %lums stopped)\n", idleTimeout);
+#if !CONFIG_PM_ENABLE
+  // Stock arduino-esp32 builds lack PM support: idle only slows the loop
+  // and BLE interval, and the IDLE energy estimate is optimistic
+  Serial.println("[Power] WARNING: CONFIG_PM_ENABLE not set, no light sleep in idle");
+#endif
+}
+
+void PowerManager::notifyActivity(unsigned long now) {
+  lastActivity = now;
+  activityPending = true;
+}
+
+void PowerManager::update(unsigned long now) {
+  account(now);
+
+  bool moving = motors->isMoving();
+
+  if (state == POWER_ACTIVE) {
+    if (moving) {
+      lastActivity = now;
+    } else if (idleTimeout > 0 && now - lastActivity >= idleTimeout) {
+      enterIdle(now);
+    }
+    activityPending = false;
+  } else {
+    if (moving || activityPending || !motors->isAsleep()) {
+      activityPending = false;
+      exitIdle(now);
+    }
+  }
+}
+
+void PowerManager::account(unsigned long now) {
+  unsigned long elapsed = now - lastUpdate;
+  lastUpdate = now;
+
+  PowerBucket bucket = currentBucket();
+  timeInBucket[bucket] += elapsed;
+  chargeMilliAmpMs += (uint64_t)BUCKET_CURRENT_MA[bucket] * elapsed;
+}
+
+PowerBucket PowerManager::currentBucket() const {
+  if (state == POWER_IDLE) return BUCKET_IDLE;
+  return motors->isMoving() ? BUCKET_MOVING : BUCKET_STOPPED;
+}
+
+void PowerManager::enterIdle(unsigned long now) {
+  state = POWER_IDLE;
+  idleEntries++;
+
+  motors->sleep();
+  ble->setLowPowerMode(true);
+  configureLightSleep(true);
+
+  Serial.printf("[Power] Idle after %lums stopped\n", now - lastActivity);
+}
+
+void PowerManager::exitIdle(unsigned long now) {
+  state = POWER_ACTIVE;
+  lastActivity = now;
+
+  configureLightSleep(false);
+  ble->setLowPowerMode(false);
+  motors->wake();
+
+  Serial.println("[Power] Active");
+}
+
+void PowerManager::configureLightSleep(bool enabled) {
+#if CONFIG_PM_ENABLE
+  esp_pm_config_t config = {
+    .max_freq_mhz = PM_MAX_FREQ_MHZ,
+    .min_freq_mhz = enabled ? PM_MIN_FREQ_MHZ : PM_MAX_FREQ_MHZ,
+    .light_sleep_enable = enabled
+  };
+  esp_err_t err = esp_pm_configure(&config);
+  if (err != ESP_OK) {
+    Serial.printf("[Power] esp_pm_configure failed: %d\n", err);
+  }
+#else
+  (void)enabled;
+#endif
+}
+
+void PowerManager::setIdleTimeout(unsigned long ms) {
+  idleTimeout = ms;
+}
+
+unsigned long PowerManager::getIdleTimeout() const {
+  return idleTimeout;
+}
+
+PowerState PowerManager::getState() const {
+  return state;
+}
+
+unsigned long PowerManager::getTickInterval() const {
+  return (state == POWER_IDLE) ? IDLE_TICK_MS : ACTIVE_TICK_MS;
+}
+
+unsigned long PowerManager::getTimeInState(PowerBucket bucket) const {
+  return timeInBucket[bucket];
+}
+
+uint32_t PowerManager::getEnergyMilliJoules() const {
+  // mA * ms * mV = 1e-9 J
+  return (uint32_t)(chargeMilliAmpMs * SUPPLY_MILLIVOLTS / 1000000ULL);
+}
+
+uint32_t PowerManager::getIdleEntries() const {
+  return idleEntries;
+}
+
+String PowerManager::getTelemetry() const {
+  String telemetry = "PWR:";
+  telemetry += (state == POWER_IDLE) ? "IDLE" : "ACTIVE";
+  telemetry += ":";
+  telemetry += String(timeInBucket[BUCKET_MOVING] / 1000);
+  telemetry += ":";
+  telemetry += String(timeInBucket[BUCKET_STOPPED] / 1000);
+  telemetry += ":";
+  telemetry += String(timeInBucket[BUCKET_IDLE] / 1000);
+  telemetry += ":";
+  telemetry += String(getEnergyMilliJoules() / 1000);
+  return telemetry;
+}
@@ -0,0 +1,101 @@
+/*
+ * power_manager.h
+ * Idle power management for long beacon-hunting sessions
+ *
+ * States:
+ *   ACTIVE - normal operation, 10 ms control tick, PWM attached
+ *   IDLE   - entered after the rover has been stopped for the idle
+ *            timeout; PWM detached, slow BLE connection interval and
+ *            automatic light sleep between control ticks
+ *
+ * Any BLE write, serial input or motor command returns to ACTIVE.
+ * Time is always passed in explicitly so the state machine can be
+ * driven from a simulated clock.
+ */
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include "motor_control.h"
+#include "ble_manager.h"
+
+// Timing
+#define ACTIVE_TICK_MS            10      // Control loop period when active
+#define IDLE_TICK_MS              100     // Loop period when idle (bounds serial wake latency)
+#define DEFAULT_IDLE_TIMEOUT_MS   30000   // Stopped time before entering idle
+
+// Energy estimate (whole-rover supply current, excluding motor load)
+#define SUPPLY_MILLIVOLTS         7400
+#define CURRENT_MOVING_MA         900
+#define CURRENT_STOPPED_MA        120
+#define CURRENT_IDLE_MA           25
+
+// Light sleep CPU frequency limits
+#define PM_MAX_FREQ_MHZ           160
+#define PM_MIN_FREQ_MHZ           40
+
+enum PowerState {
+  POWER_ACTIVE,
+  POWER_IDLE
+};
+
+// Accounting buckets for time-in-state and energy counters
+enum PowerBucket {
+  BUCKET_MOVING,
+  BUCKET_STOPPED,
+  BUCKET_IDLE,
+  BUCKET_COUNT
+};
+
+class PowerManager {
+public:
+  PowerManager(MotorControl* motors, BLEManager* ble);
+
+  void begin(unsigned long now);
+
+  // Advance the state machine; call once per loop iteration
+  void update(unsigned long now);
+
+  // Report a command or input event (safe to call from BLE callbacks)
+  void notifyActivity(unsigned long now);
+
+  void setIdleTimeout(unsigned long ms);   // 0 disables idle mode
+  unsigned long getIdleTimeout() const;
+
+  PowerState getState() const;
+
+  // Delay to apply between loop iterations in the current state
+  unsigned long getTickInterval() const;
+
+  // Counters
+  unsigned long getTimeInState(PowerBucket bucket) const;
+  uint32_t getEnergyMilliJoules() const;
+  uint32_t getIdleEntries() const;
+
+  // Telemetry line: PWR:<state>:<moving s>:<stopped s>:<idle s>:<J>
+  String getTelemetry() const;
+
+private:
+  MotorControl* motors;
+  BLEManager* ble;
+
+  PowerState state;
+  unsigned long idleTimeout;
+  volatile unsigned long lastActivity;
+  volatile bool activityPending;
+  unsigned long lastUpdate;
+
+  unsigned long timeInBucket[BUCKET_COUNT];
+  uint64_t chargeMilliAmpMs;
+  uint32_t idleEntries;
+
+  void account(unsigned long now);
+  PowerBucket currentBucket() const;
+
+  void enterIdle(unsigned long now);
+  void exitIdle(unsigned long now);
+  void configureLightSleep(bool enabled);
+};
+
+#endif // POWER_MANAGER_H
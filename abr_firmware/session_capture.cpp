@@ -0,0 +1,239 @@
+/*
+ * session_capture.cpp
+ * Session capture implementation
+ */
+
+#include "session_capture.h"
+
+SessionCapture capture;
+
+SessionCapture::SessionCapture()
+  : head(0), size(0), startMicros(0), recording(false),
+    lock(portMUX_INITIALIZER_UNLOCKED), motion(nullptr), calibrated(false) {
+}
+
+void SessionCapture::start() {
+  clear();
+  if (motion != nullptr) {
+    calibration = motion->getCalibration();
+    calibrated = true;
+  }
+  startMicros = micros();
+  recording = true;
+  Serial.println("[Capture] Recording started");
+}
+
+void SessionCapture::stop() {
+  recording = false;
+  Serial.printf("[Capture] Recording stopped (%d records)\n", (int)size);
+}
+
+void SessionCapture::clear() {
+  portENTER_CRITICAL(&lock);
+  head = 0;
+  size = 0;
+  portEXIT_CRITICAL(&lock);
+  calibrated = false;
+}
+
+bool SessionCapture::isRecording() const {
+  return recording;
+}
+
+void SessionCapture::append(const CaptureRecord& record) {
+  // Both the loop task and BLE callbacks record; oldest entries are
+  // overwritten once the ring is full
+  portENTER_CRITICAL(&lock);
+  size_t index = (head + size) % CAPTURE_RECORDS;
+  records[index] = record;
+  if (size < CAPTURE_RECORDS) {
+    size++;
+  } else {
+    head = (head + 1) % CAPTURE_RECORDS;
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+void SessionCapture::recordInput(CaptureType type, const uint8_t* data, size_t length) {
+  if (!recording) return;
+
+  CaptureRecord record = {};
+  record.timeUs = micros() - startMicros;
+  record.type = type;
+  record.length = min(length, (size_t)CAPTURE_PAYLOAD_MAX);
+  record.truncated = length > CAPTURE_PAYLOAD_MAX;
+  memcpy(record.data, data, record.length);
+  append(record);
+}
+
+void SessionCapture::recordEvent(CaptureCause cause) {
+  uint8_t payload = cause;
+  recordInput(CAPTURE_EVENT, &payload, 1);
+}
+
+void SessionCapture::setMotionModel(const MotionModel* model) {
+  motion = model;
+}
+
+bool SessionCapture::hasCalibration() const {
+  return calibrated;
+}
+
+const MotionTable& SessionCapture::getCalibration() const {
+  return calibration;
+}
+
+void SessionCapture::recordOutput(Direction leftDir, uint8_t leftDuty,
+                                  Direction rightDir, uint8_t rightDuty) {
+  if (!capture.recording) return;
+
+  CaptureRecord record = {};
+  record.timeUs = micros() - capture.startMicros;
+  record.type = CAPTURE_MOTOR_OUTPUT;
+  record.length = 4;
+  record.truncated = false;
+  record.data[0] = leftDir;
+  record.data[1] = leftDuty;
+  record.data[2] = rightDir;
+  record.data[3] = rightDuty;
+  capture.append(record);
+}
+
+size_t SessionCapture::count() const {
+  return size;
+}
+
+const CaptureRecord& SessionCapture::at(size_t index) const {
+  return records[(head + index) % CAPTURE_RECORDS];
+}
+
+size_t SessionCapture::byteSize() const {
+  return size * CAPTURE_WIRE_SIZE;
+}
+
+void SessionCapture::serialize(const CaptureRecord& record, uint8_t* wire) {
+  // Explicit layout: independent of struct padding and the compiler ABI
+  memset(wire, 0, CAPTURE_WIRE_SIZE);
+  wire[0] = record.timeUs;
+  wire[1] = record.timeUs >> 8;
+  wire[2] = record.timeUs >> 16;
+  wire[3] = record.timeUs >> 24;
+  wire[4] = record.type;
+  wire[5] = record.truncated ? CAPTURE_WIRE_TRUNCATED : 0;
+  wire[6] = record.length;
+  memcpy(wire + 8, record.data, min(record.length, (uint8_t)CAPTURE_PAYLOAD_MAX));
+}
+
+size_t SessionCapture::readBytes(uint32_t offset, uint8_t* buffer, size_t length) const {
+  uint8_t wire[CAPTURE_WIRE_SIZE];
+  size_t copied = 0;
+  while (copied < length && offset < byteSize()) {
+    size_t within = offset % CAPTURE_WIRE_SIZE;
+    size_t chunk = min(CAPTURE_WIRE_SIZE - within, length - copied);
+    serialize(at(offset / CAPTURE_WIRE_SIZE), wire);
+    memcpy(buffer + copied, wire + within, chunk);
+    copied += chunk;
+    offset += chunk;
+  }
+  return copied;
+}
+
+void SessionCapture::dump() const {
+  Serial.printf("[Capture] %d records\n", (int)size);
+  if (calibrated) {
+    // Full fits, so replayed K feedback refines them as it did live
+    for (uint8_t k = 0; k < MOTION_KIND_COUNT; k++) {
+      for (uint8_t i = 0; i < MOTION_SPEED_LEVELS; i++) {
+        const MotionFit& fit = calibration.fits[k][i];
+        Serial.printf(CAPTURE_LINE_PREFIX CAPTURE_CAL_PREFIX "%d %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %d\n",
+                      k, i, fit.rate, fit.offset, fit.sumW, fit.sumT, fit.sumD,
+                      fit.sumTT, fit.sumTD, fit.samples);
+      }
+    }
+  }
+  for (size_t i = 0; i < size; i++) {
+    const CaptureRecord& record = at(i);
+    Serial.printf(CAPTURE_LINE_PREFIX "%lu %c%s ", (unsigned long)record.timeUs, record.type,
+                  record.truncated ? "~" : "");
+    for (uint8_t b = 0; b < record.length; b++) {
+      Serial.printf("%02X", record.data[b]);
+    }
+    Serial.println();
+  }
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+bool SessionCapture::loadCalibration(const char* p) {
+  // <kind> <level> <rate> <offset> <sumW> <sumT> <sumD> <sumTT> <sumTD> <samples>
+  char* next = nullptr;
+  long kind = strtol(p, &next, 10);
+  if (next == p || kind < 0 || kind >= MOTION_KIND_COUNT) return false;
+  p = next;
+  long level = strtol(p, &next, 10);
+  if (next == p || level < 0 || level >= MOTION_SPEED_LEVELS) return false;
+  p = next;
+
+  MotionFit fit;
+  float* values[] = { &fit.rate, &fit.offset, &fit.sumW, &fit.sumT,
+                      &fit.sumD, &fit.sumTT, &fit.sumTD };
+  for (float* value : values) {
+    *value = strtof(p, &next);
+    if (next == p) return false;
+    p = next;
+  }
+  long samples = strtol(p, &next, 10);
+  if (next == p || samples < 0 || samples > UINT16_MAX) return false;
+  fit.samples = samples;
+
+  // Fits missing from the dump keep their defaults
+  if (!calibrated) {
+    calibration = MotionModel().getCalibration();
+    calibrated = true;
+  }
+  calibration.fits[kind][level] = fit;
+  return true;
+}
+
+bool SessionCapture::load(const String& line) {
+  // CAP <time us> <type>[~] <payload hex>
+  const char* p = line.c_str() + strlen(CAPTURE_LINE_PREFIX);
+  char* next = nullptr;
+
+  if (strncmp(p, CAPTURE_CAL_PREFIX, strlen(CAPTURE_CAL_PREFIX)) == 0) {
+    return loadCalibration(p + strlen(CAPTURE_CAL_PREFIX));
+  }
+
+  CaptureRecord record;
+  record.timeUs = strtoul(p, &next, 10);
+  if (next == p || *next != ' ') return false;
+  p = next + 1;
+
+  record.type = *p++;
+  if (record.type != CAPTURE_BLE_WRITE && record.type != CAPTURE_SERIAL_INPUT &&
+      record.type != CAPTURE_MOTOR_OUTPUT && record.type != CAPTURE_EVENT) {
+    return false;
+  }
+  record.truncated = (*p == CAPTURE_TRUNCATED);
+  if (record.truncated) p++;
+  while (*p == ' ') p++;
+
+  record.length = 0;
+  while (p[0] && p[1] && record.length < CAPTURE_PAYLOAD_MAX) {
+    int high = hexValue(p[0]);
+    int low = hexValue(p[1]);
+    if (high < 0 || low < 0) break;
+    record.data[record.length++] = (high << 4) | low;
+    p += 2;
+  }
+
+  if (record.type == CAPTURE_EVENT && record.length != 1) return false;
+  if (size > 0 && record.timeUs < at(size - 1).timeUs) return false;
+  append(record);
+  return true;
+}
@@ -0,0 +1,123 @@
+/*
+ * session_capture.h
+ * Timestamped capture of control inputs and motor outputs
+ *
+ * Records BLE control writes, serial input lines and applied motor
+ * duties into a fixed ring so a field session can be dumped, reloaded
+ * and replayed (see session_replay.h).
+ *
+ * Text format (one record per line, as printed by dump() and accepted
+ * by load()):
+ *   CAP <time us> <type>[~] <payload hex>
+ *
+ * Types: B = BLE write, S = serial input, M = motor output,
+ *        E = firmware event (motors stopped or held without a command)
+ * Motor output payload: left dir, left duty, right dir, right duty
+ * Event payload: one CaptureCause byte
+ * A '~' after the type marks an input longer than CAPTURE_PAYLOAD_MAX
+ * whose payload was cut; replay skips those records.
+ *
+ * The motion calibration in use when recording started is dumped first
+ * so D/T moves replay with the same plans, one line per fit:
+ *   CAP CAL <kind> <level> <rate> <offset> <sumW> <sumT> <sumD> <sumTT> <sumTD> <samples>
+ * It is not part of the bulk wire format.
+ */
+
+#ifndef SESSION_CAPTURE_H
+#define SESSION_CAPTURE_H
+
+#include <Arduino.h>
+#include "motor_control.h"
+#include "command_interface.h"
+
+#define CAPTURE_RECORDS       256
+#define CAPTURE_PAYLOAD_MAX   COMMAND_MAX_LENGTH
+#define CAPTURE_LINE_PREFIX   "CAP "
+#define CAPTURE_CAL_PREFIX    "CAL "
+#define CAPTURE_TRUNCATED     '~'
+#define CAPTURE_WIRE_SIZE     (8 + CAPTURE_PAYLOAD_MAX)
+#define CAPTURE_WIRE_TRUNCATED  0x01
+
+enum CaptureType : uint8_t {
+  CAPTURE_BLE_WRITE    = 'B',
+  CAPTURE_SERIAL_INPUT = 'S',
+  CAPTURE_MOTOR_OUTPUT = 'M',
+  CAPTURE_EVENT        = 'E'
+};
+
+// Why the firmware changed the motor outputs on its own
+enum CaptureCause : uint8_t {
+  CAPTURE_CAUSE_IDLE     = 'I',     // Idle power mode put the motors to sleep
+  CAPTURE_CAUSE_TIMEOUT  = 'T',     // Safety timeout stopped the motors
+  CAPTURE_CAUSE_OBSTACLE = 'O',     // Forward guard stopped a running move
+  CAPTURE_CAUSE_BLOCKED  = 'X'      // A motor guard refused the next command
+};
+
+struct CaptureRecord {
+  uint32_t timeUs;                  // Since capture start
+  uint8_t type;                     // CaptureType
+  uint8_t length;
+  bool truncated;                   // Input exceeded CAPTURE_PAYLOAD_MAX
+  uint8_t data[CAPTURE_PAYLOAD_MAX];
+};
+
+class SessionCapture {
+public:
+  SessionCapture();
+
+  void start();
+  void stop();
+  void clear();
+  bool isRecording() const;
+
+  void recordInput(CaptureType type, const uint8_t* data, size_t length);
+  void recordEvent(CaptureCause cause);
+
+  // Model whose calibration is saved when recording starts (optional)
+  void setMotionModel(const MotionModel* model);
+
+  // Calibration captured or loaded with the records, if any
+  bool hasCalibration() const;
+  const MotionTable& getCalibration() const;
+
+  // MotorOutputObserver-compatible hook
+  static void recordOutput(Direction leftDir, uint8_t leftDuty,
+                           Direction rightDir, uint8_t rightDuty);
+
+  // Records in chronological order
+  size_t count() const;
+  const CaptureRecord& at(size_t index) const;
+
+  // Records serialized back to back, CAPTURE_WIRE_SIZE bytes each, for
+  // the bulk transfer channel; returns bytes copied. Wire layout:
+  //   u32 time us (little endian), u8 type, u8 flags (bit 0 = truncated),
+  //   u8 length, u8 reserved (0), payload zero-padded to CAPTURE_PAYLOAD_MAX
+  size_t byteSize() const;
+  size_t readBytes(uint32_t offset, uint8_t* buffer, size_t length) const;
+
+  // Print all records in text format
+  void dump() const;
+
+  // Append one record parsed from a text line, returns false if malformed
+  bool load(const String& line);
+
+private:
+  CaptureRecord records[CAPTURE_RECORDS];
+  size_t head;                      // Index of the oldest record
+  size_t size;
+  uint32_t startMicros;
+  bool recording;
+  portMUX_TYPE lock;
+
+  const MotionModel* motion;
+  MotionTable calibration;
+  bool calibrated;
+
+  void append(const CaptureRecord& record);
+  bool loadCalibration(const char* p);
+  static void serialize(const CaptureRecord& record, uint8_t* wire);
+};
+
+extern SessionCapture capture;
+
+#endif // SESSION_CAPTURE_H
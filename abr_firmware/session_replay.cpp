@@ -0,0 +1,295 @@
+/*
+ * session_replay.cpp
+ * Session replay implementation
+ */
+
+#include "session_replay.h"
+
+SessionReplay* SessionReplay::active = nullptr;
+uint32_t SessionReplay::virtualUs = 0;
+
+SessionReplay::SessionReplay(MotorControl* motors, MotionModel* motion,
+                             CommandInterface* commands, BLEManager* ble)
+  : motors(motors), motion(motion), commands(commands), ble(ble),
+    outputCount(0), latencyCount(0),
+    inputStartMicros(0), inputPending(false), blockPending(false), nextTickUs(0) {
+}
+
+unsigned long SessionReplay::virtualMillis() {
+  return virtualUs / 1000;
+}
+
+void SessionReplay::onOutput(Direction leftDir, uint8_t leftDuty,
+                             Direction rightDir, uint8_t rightDuty) {
+  SessionReplay* self = active;
+  if (self == nullptr) return;
+
+  if (self->inputPending) {
+    self->inputPending = false;
+    self->latencies[self->latencyCount++] = micros() - self->inputStartMicros;
+  }
+
+  if (self->outputCount < REPLAY_MAX_OUTPUTS) {
+    ReplayOutput& output = self->outputs[self->outputCount++];
+    output.timeUs = virtualUs;
+    output.duty[0] = leftDir;
+    output.duty[1] = leftDuty;
+    output.duty[2] = rightDir;
+    output.duty[3] = rightDuty;
+  }
+}
+
+bool SessionReplay::replayGuard() {
+  SessionReplay* self = active;
+  return self == nullptr || !self->blockPending;
+}
+
+bool SessionReplay::isCommand(const CaptureRecord& record) {
+  return record.type == CAPTURE_BLE_WRITE || record.type == CAPTURE_SERIAL_INPUT;
+}
+
+void SessionReplay::advanceTo(uint32_t timeUs) {
+  // Run the control ticks the main loop would have run in between
+  while (nextTickUs <= timeUs) {
+    virtualUs = nextTickUs;
+    commands->update();
+    nextTickUs += REPLAY_TICK_MS * 1000UL;
+  }
+  virtualUs = timeUs;
+}
+
+void SessionReplay::inject(const SessionCapture& capture, size_t index) {
+  const CaptureRecord& record = capture.at(index);
+  if (record.type == CAPTURE_EVENT) {
+    injectEvent(record.data[0]);
+    return;
+  }
+
+  // A refusal recorded before the next command belongs to this one
+  blockPending = false;
+  for (size_t i = index + 1; i < capture.count() && !isCommand(capture.at(i)); i++) {
+    const CaptureRecord& next = capture.at(i);
+    if (next.type == CAPTURE_EVENT && next.data[0] == CAPTURE_CAUSE_BLOCKED) {
+      blockPending = true;
+    }
+  }
+
+  inputStartMicros = micros();
+  inputPending = (latencyCount < REPLAY_MAX_OUTPUTS);
+
+  if (record.type == CAPTURE_BLE_WRITE) {
+    ble->replayControlWrite(record.data, record.length);
+  } else {
+    commands->execute(commands->parse(record.data, record.length));
+    commands->clearResponse();
+  }
+
+  // Inputs that did not actuate carry no latency sample
+  inputPending = false;
+  blockPending = false;
+}
+
+void SessionReplay::injectEvent(uint8_t cause) {
+  switch (cause) {
+    case CAPTURE_CAUSE_IDLE:
+      motors->sleep();
+      break;
+    case CAPTURE_CAUSE_TIMEOUT:
+    case CAPTURE_CAUSE_OBSTACLE:
+      motors->stop();
+      break;
+    default:
+      // Refusals are repeated by replayGuard() with their command
+      break;
+  }
+}
+
+bool SessionReplay::run(const SessionCapture& capture) {
+  if (capture.count() == 0) {
+    Serial.println("[Replay] Capture is empty");
+    return false;
+  }
+
+  Serial.printf("[Replay] Replaying %d records (dry run)\n", (int)capture.count());
+
+  // Stop the rover first; a running move ends with its odometry applied.
+  // Holding the command lock lets a BLE command already in flight finish
+  // and keeps the restored state from interleaving with a new one.
+  ble->setReplayActive(true);
+  commands->lock();
+  motors->wake();
+  motors->stop();
+  commands->update();
+
+  // Live state to restore afterwards
+  CommandInterface liveCommands = *commands;
+  MotionModel liveMotion = *motion;
+
+  // Mocked backend and virtual clock
+  ForwardGuard liveForwardGuard = motors->getForwardGuard();
+  MotionGuard liveMotionGuard = motors->getMotionGuard();
+  motors->setDryRun(true);
+  motors->setForwardGuard(nullptr);
+  motors->setMotionGuard(replayGuard);
+  commands->setPositionEstimator(nullptr);
+  commands->reset();
+
+  // Plan moves as the captured session did
+  if (capture.hasCalibration()) {
+    motion->setCalibration(capture.getCalibration());
+  } else {
+    Serial.println("[Replay] No calibration in capture, using the live one");
+  }
+
+  outputCount = 0;
+  latencyCount = 0;
+  virtualUs = 0;
+  nextTickUs = 0;
+  active = this;
+  motors->setOutputObserver(onOutput);
+  commands->setClock(virtualMillis);
+
+  uint32_t endUs = 0;
+  size_t skipped = 0;
+  for (size_t i = 0; i < capture.count(); i++) {
+    const CaptureRecord& record = capture.at(i);
+    endUs = record.timeUs;
+    if (record.type == CAPTURE_MOTOR_OUTPUT) continue;
+    if (record.type == CAPTURE_EVENT && record.data[0] == CAPTURE_CAUSE_BLOCKED) continue;
+
+    // A cut-off command would replay as a different one
+    if (record.truncated) {
+      skipped++;
+      continue;
+    }
+
+    advanceTo(record.timeUs);
+    inject(capture, i);
+
+    // Let the idle task run; serial logging dominates replay time
+    delay(1);
+  }
+  advanceTo(endUs + REPLAY_TAIL_MS * 1000UL);
+
+  // Restore live operation
+  motors->setOutputObserver(SessionCapture::recordOutput);
+  active = nullptr;
+  motors->wake();
+  motors->stop();
+  motors->setForwardGuard(liveForwardGuard);
+  motors->setMotionGuard(liveMotionGuard);
+  motors->setDryRun(false);
+  *commands = liveCommands;
+  *motion = liveMotion;
+  commands->unlock();
+  ble->setReplayActive(false);
+
+  // Report
+  if (skipped > 0) {
+    Serial.printf("[Replay] Skipped %d truncated inputs\n", (int)skipped);
+  }
+  printTimeline();
+
+  uint32_t golden[REPLAY_MAX_OUTPUTS];
+  size_t goldenCount = goldenLatencies(capture, golden);
+  printLatency("capture", golden, goldenCount);
+  printLatency("replay", latencies, latencyCount);
+
+  bool match = compare(capture);
+  Serial.printf("[Replay] Result: %s\n", match ? "MATCH" : "DIVERGED");
+  return match;
+}
+
+size_t SessionReplay::goldenLatencies(const SessionCapture& capture, uint32_t* result) const {
+  // Command -> first motor output before the next input; events the
+  // command raised (a refusal) may sit in between
+  size_t count = 0;
+  for (size_t i = 0; i < capture.count() && count < REPLAY_MAX_OUTPUTS; i++) {
+    const CaptureRecord& input = capture.at(i);
+    if (!isCommand(input)) continue;
+
+    size_t next = i + 1;
+    while (next < capture.count() && capture.at(next).type == CAPTURE_EVENT &&
+           capture.at(next).data[0] == CAPTURE_CAUSE_BLOCKED) {
+      next++;
+    }
+    if (next < capture.count() && capture.at(next).type == CAPTURE_MOTOR_OUTPUT) {
+      result[count++] = capture.at(next).timeUs - input.timeUs;
+    }
+  }
+  return count;
+}
+
+bool SessionReplay::compare(const SessionCapture& capture) const {
+  size_t index = 0;
+  for (size_t i = 0; i < capture.count(); i++) {
+    const CaptureRecord& golden = capture.at(i);
+    if (golden.type != CAPTURE_MOTOR_OUTPUT) continue;
+
+    if (index >= outputCount) {
+      Serial.printf("[Replay] Divergence: missing output #%d at %luus\n",
+                    (int)index, (unsigned long)golden.timeUs);
+      return false;
+    }
+
+    const ReplayOutput& output = outputs[index];
+    uint32_t skew = (output.timeUs > golden.timeUs) ?
+                    output.timeUs - golden.timeUs : golden.timeUs - output.timeUs;
+
+    if (memcmp(output.duty, golden.data, sizeof(output.duty)) != 0 ||
+        skew > REPLAY_TIME_TOLERANCE_US) {
+      Serial.printf("[Replay] Divergence at output #%d: golden %luus L%d:%d R%d:%d, "
+                    "replay %luus L%d:%d R%d:%d\n", (int)index,
+                    (unsigned long)golden.timeUs, golden.data[0], golden.data[1],
+                    golden.data[2], golden.data[3],
+                    (unsigned long)output.timeUs, output.duty[0], output.duty[1],
+                    output.duty[2], output.duty[3]);
+      return false;
+    }
+    index++;
+  }
+
+  if (index < outputCount) {
+    Serial.printf("[Replay] Divergence: %d extra outputs\n", (int)(outputCount - index));
+    return false;
+  }
+  return true;
+}
+
+void SessionReplay::printLatency(const char* label, uint32_t* values, size_t count) {
+  if (count == 0) {
+    Serial.printf("[Replay] %s latency: no samples\n", label);
+    return;
+  }
+
+  // Insertion sort, at most REPLAY_MAX_OUTPUTS samples
+  for (size_t i = 1; i < count; i++) {
+    uint32_t value = values[i];
+    size_t j = i;
+    while (j > 0 && values[j - 1] > value) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = value;
+  }
+
+  Serial.printf("[Replay] %s latency us: n=%d p50=%lu p90=%lu p99=%lu max=%lu\n",
+                label, (int)count,
+                (unsigned long)values[count * 50 / 100],
+                (unsigned long)values[count * 90 / 100],
+                (unsigned long)values[count * 99 / 100],
+                (unsigned long)values[count - 1]);
+}
+
+void SessionReplay::printTimeline() const {
+  static const char DIR_CHARS[] = { 'S', 'F', 'B' };
+
+  Serial.printf("[Replay] Duty timeline (%d outputs):\n", (int)outputCount);
+  for (size_t i = 0; i < outputCount; i++) {
+    const ReplayOutput& output = outputs[i];
+    Serial.printf("  %8lu ms  L %c %3d  R %c %3d\n",
+                  (unsigned long)(output.timeUs / 1000),
+                  DIR_CHARS[output.duty[0] % 3], output.duty[1],
+                  DIR_CHARS[output.duty[2] % 3], output.duty[3]);
+  }
+}
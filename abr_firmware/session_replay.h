@@ -0,0 +1,90 @@
+/*
+ * session_replay.h
+ * Deterministic replay of a captured control session
+ *
+ * Feeds the inputs of a SessionCapture through CommandInterface ->
+ * MotorControl with the motors in dry-run mode (no GPIO/PWM) and
+ * CommandInterface on a virtual clock stepped at the control tick.
+ * Reports the resulting duty timeline, command-to-actuation latency
+ * percentiles for the capture and the replay, and the first divergence
+ * from the captured (golden) motor outputs.
+ *
+ * BLE writes are fed through BLEManager::replayControlWrite, serial
+ * lines straight to the command interface as the loop does. Firmware
+ * events are repeated: idle sleep, safety timeout and obstacle stops
+ * at their captured time, and a refused command by a stand-in motion
+ * guard. Moves are planned with the calibration saved in the
+ * capture, or the live one if it has none.
+ *
+ * A replay leaves no trace: replayed writes count no metrics, fire no
+ * app callback and notify nothing, the position estimator is detached,
+ * and the command and motion model state are restored afterwards, so
+ * replayed K feedback never reaches NVS. Live BLE control writes are
+ * refused with a BUSY:REPLAY status meanwhile. Truncated input records
+ * are skipped.
+ */
+
+#ifndef SESSION_REPLAY_H
+#define SESSION_REPLAY_H
+
+#include <Arduino.h>
+#include "motor_control.h"
+#include "command_interface.h"
+#include "ble_manager.h"
+#include "session_capture.h"
+
+#define REPLAY_TICK_MS            10      // Control tick (matches ACTIVE_TICK_MS)
+#define REPLAY_TAIL_MS            1000    // Keep ticking after the last input
+#define REPLAY_MAX_OUTPUTS        CAPTURE_RECORDS
+#define REPLAY_TIME_TOLERANCE_US  (2 * REPLAY_TICK_MS * 1000UL)
+
+struct ReplayOutput {
+  uint32_t timeUs;
+  uint8_t duty[4];                  // Same layout as a motor output record
+};
+
+class SessionReplay {
+public:
+  SessionReplay(MotorControl* motors, MotionModel* motion,
+                CommandInterface* commands, BLEManager* ble);
+
+  // Replay the capture and print the report; true if outputs match
+  bool run(const SessionCapture& capture);
+
+private:
+  MotorControl* motors;
+  MotionModel* motion;
+  CommandInterface* commands;
+  BLEManager* ble;
+
+  ReplayOutput outputs[REPLAY_MAX_OUTPUTS];
+  size_t outputCount;
+
+  uint32_t latencies[REPLAY_MAX_OUTPUTS];
+  size_t latencyCount;
+
+  uint32_t inputStartMicros;
+  bool inputPending;
+  bool blockPending;                // Captured guard refused this input
+  uint32_t nextTickUs;
+
+  static SessionReplay* active;
+  static uint32_t virtualUs;
+
+  static unsigned long virtualMillis();
+  static void onOutput(Direction leftDir, uint8_t leftDuty,
+                       Direction rightDir, uint8_t rightDuty);
+  static bool replayGuard();
+
+  void advanceTo(uint32_t timeUs);
+  void inject(const SessionCapture& capture, size_t index);
+  void injectEvent(uint8_t cause);
+  static bool isCommand(const CaptureRecord& record);
+  size_t goldenLatencies(const SessionCapture& capture, uint32_t* result) const;
+  bool compare(const SessionCapture& capture) const;
+
+  static void printLatency(const char* label, uint32_t* values, size_t count);
+  void printTimeline() const;
+};
+
+#endif // SESSION_REPLAY_H
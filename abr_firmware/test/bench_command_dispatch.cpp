@@ -0,0 +1,100 @@
+/*
+ * bench_command_dispatch.cpp
+ * Per-command cost of parsing and table dispatch
+ *
+ * Host numbers are only useful relative to each other: the indexed
+ * lookup against a linear scan of the same registry, and text against
+ * binary framing.
+ */
+
+#include <chrono>
+#include "test.h"
+#include "command_interface.h"
+
+#define ITERATIONS 200000
+
+static const char* const TEXT_COMMANDS[] = {
+  "F:200:500", "B", "L:150", "R:150:300", "G", "H:180", "S", "M:120:-120",
+  "J:40:80", "V:200", "D:500", "T:-90:185", "K:480", "A:1:0:3000",
+  "P:1:-62", "N:1500:1500", "W", "?", "Q",
+};
+#define TEXT_COUNT (sizeof(TEXT_COMMANDS) / sizeof(TEXT_COMMANDS[0]))
+
+static volatile int sink;
+
+// Reference: find the registry row by walking the table
+static const CommandSpec* scanTable(char opcode) {
+  for (size_t i = 0; i < CommandInterface::commandCount; i++) {
+    if (CommandInterface::commandTable[i].opcode == opcode) {
+      return &CommandInterface::commandTable[i];
+    }
+  }
+  return nullptr;
+}
+
+template <typename F>
+static double nsPerCall(F body, size_t callsPerIteration) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) body();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         ((double)ITERATIONS * callsPerIteration);
+}
+
+int main() {
+  MotorControl motors;
+  MotionModel motion;
+  motion.begin();
+  CommandInterface commands(&motors, &motion);
+
+  size_t textLengths[TEXT_COUNT];
+  uint8_t binary[TEXT_COUNT][1 + 2 * COMMAND_MAX_ARGS];
+  size_t binaryLengths[TEXT_COUNT];
+  for (size_t i = 0; i < TEXT_COUNT; i++) {
+    textLengths[i] = strlen(TEXT_COMMANDS[i]);
+    Command cmd = commands.parse((const uint8_t*)TEXT_COMMANDS[i], textLengths[i]);
+    int16_t args[COMMAND_MAX_ARGS] = { cmd.param1, cmd.param2, cmd.param3 };
+    binary[i][0] = TEXT_COMMANDS[i][0] | BINARY_OPCODE_FLAG;
+    binaryLengths[i] = 1;
+    for (size_t a = 0; a < COMMAND_MAX_ARGS && cmd.hasParams; a++) {
+      binary[i][binaryLengths[i]++] = args[a] & 0xFF;
+      binary[i][binaryLengths[i]++] = (args[a] >> 8) & 0xFF;
+    }
+  }
+
+  double scan = nsPerCall([&] {
+    for (size_t i = 0; i < TEXT_COUNT; i++) sink = scanTable(TEXT_COMMANDS[i][0])->type;
+  }, TEXT_COUNT);
+
+  double text = nsPerCall([&] {
+    for (size_t i = 0; i < TEXT_COUNT; i++) {
+      sink = commands.parse((const uint8_t*)TEXT_COMMANDS[i], textLengths[i]).type;
+    }
+  }, TEXT_COUNT);
+
+  double bin = nsPerCall([&] {
+    for (size_t i = 0; i < TEXT_COUNT; i++) {
+      sink = commands.parse(binary[i], binaryLengths[i]).type;
+    }
+  }, TEXT_COUNT);
+
+  // Parse plus handler for commands that do not start a move
+  static const char* const CHEAP[] = { "V:200", "S", "N:1500:1500", "K:480" };
+  double dispatch = nsPerCall([&] {
+    for (const char* c : CHEAP) commands.process((const uint8_t*)c, strlen(c));
+  }, sizeof(CHEAP) / sizeof(CHEAP[0]));
+
+  printf("Command dispatch (%zu opcodes, %d iterations)\n", TEXT_COUNT, ITERATIONS);
+  printf("  linear scan lookup    %7.1f ns/command\n", scan);
+  printf("  text parse            %7.1f ns/command\n", text);
+  printf("  binary parse          %7.1f ns/command\n", bin);
+  printf("  parse + execute       %7.1f ns/command\n", dispatch);
+
+  // Same result from both lookups, so the numbers compare like for like
+  for (size_t i = 0; i < TEXT_COUNT; i++) {
+    Command cmd = commands.parse((const uint8_t*)TEXT_COMMANDS[i], textLengths[i]);
+    CHECK_EQ(cmd.type, scanTable(TEXT_COMMANDS[i][0])->type);
+    CHECK_EQ(commands.parse(binary[i], binaryLengths[i]).type, cmd.type);
+  }
+  TEST_MAIN_END();
+}
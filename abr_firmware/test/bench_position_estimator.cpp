@@ -0,0 +1,142 @@
+/*
+ * bench_position_estimator.cpp
+ * EKF accuracy against simulated RSSI ranging, and cost per call
+ *
+ * Four beacons at the corners of a 5 m square, RSSI with the modelled
+ * 4 dB noise, and a rover driving 300 mm legs with random turns and
+ * 5 % / 10 % odometry error. Reports the mean position and heading error
+ * after the first fix settles, next to a fresh trilateration of each
+ * round of samples as the reference.
+ */
+
+#include <chrono>
+#include <random>
+#include "test.h"
+#include "position_estimator.h"
+
+#define RUNS            50
+#define STEPS           120
+#define SETTLE_STEPS    10
+#define ARENA_MM        5000.0f
+#define LEG_MM          300.0f
+#define TX_POWER        -59.0f
+#define PATH_LOSS       2.0f
+#define COST_CALLS      200000
+
+static const float BEACONS[4][2] = {
+  { 0, 0 }, { ARENA_MM, 0 }, { ARENA_MM, ARENA_MM }, { 0, ARENA_MM }
+};
+
+struct Accuracy {
+  double position;        // Mean error, mm
+  double heading;         // Mean error, rad
+  double trilateration;   // Mean error of a fresh fix per round, mm
+};
+
+static float wrap(float angle) {
+  while (angle > (float)M_PI) angle -= 2.0f * (float)M_PI;
+  while (angle <= -(float)M_PI) angle += 2.0f * (float)M_PI;
+  return angle;
+}
+
+static float rssiAt(float x, float y, int beacon, std::mt19937& rng) {
+  std::normal_distribution<float> noise(0.0f, POSITION_RSSI_STDDEV_DB);
+  float dx = x - BEACONS[beacon][0];
+  float dy = y - BEACONS[beacon][1];
+  float range = fmaxf(sqrtf(dx * dx + dy * dy), 100.0f);
+  return TX_POWER - 10.0f * PATH_LOSS * log10f(range / 1000.0f) + noise(rng);
+}
+
+static void addBeacons(PositionEstimator& estimator) {
+  for (int b = 0; b < 4; b++) {
+    estimator.setBeacon(b + 1, BEACONS[b][0], BEACONS[b][1], TX_POWER, PATH_LOSS);
+  }
+}
+
+static Accuracy simulate() {
+  double positionSum = 0, headingSum = 0, trilaterationSum = 0;
+  size_t samples = 0;
+
+  for (int run = 0; run < RUNS; run++) {
+    std::mt19937 rng(run + 1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::normal_distribution<float> unit(0.0f, 1.0f);
+
+    PositionEstimator estimator;
+    addBeacons(estimator);
+
+    float x = ARENA_MM / 2 + 1000.0f * uniform(rng);
+    float y = ARENA_MM / 2 + 1000.0f * uniform(rng);
+    float heading = (float)M_PI * uniform(rng);
+
+    for (int step = 0; step < STEPS; step++) {
+      float rssi[4];
+      for (int b = 0; b < 4; b++) {
+        rssi[b] = rssiAt(x, y, b, rng);
+        estimator.updateRssi(b + 1, rssi[b]);
+      }
+
+      // Reference: trilateration from this round alone
+      PositionEstimator fix;
+      addBeacons(fix);
+      for (int b = 0; b < 4; b++) fix.updateRssi(b + 1, rssi[b]);
+
+      if (step >= SETTLE_STEPS && estimator.isValid()) {
+        positionSum += hypotf(estimator.getX() - x, estimator.getY() - y);
+        headingSum += fabsf(wrap(estimator.getHeading() - heading));
+        trilaterationSum += hypotf(fix.getX() - x, fix.getY() - y);
+        samples++;
+      }
+
+      // Turn, steering back towards the middle near the walls
+      float turn = 0.5f * (float)M_PI * uniform(rng);
+      float aheadX = x + 2 * LEG_MM * cosf(heading + turn);
+      float aheadY = y + 2 * LEG_MM * sinf(heading + turn);
+      if (aheadX < 500 || aheadX > ARENA_MM - 500 || aheadY < 500 || aheadY > ARENA_MM - 500) {
+        turn = wrap(atan2f(ARENA_MM / 2 - y, ARENA_MM / 2 - x) - heading);
+      }
+      heading = wrap(heading + turn * (1.0f + 0.10f * unit(rng)));
+      estimator.predict(0.0f, turn);
+
+      float driven = LEG_MM * (1.0f + 0.05f * unit(rng));
+      x += driven * cosf(heading);
+      y += driven * sinf(heading);
+      estimator.predict(LEG_MM, 0.0f);
+    }
+  }
+
+  return { positionSum / samples, headingSum / samples, trilaterationSum / samples };
+}
+
+template <typename F>
+static double nsPerCall(F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < COST_CALLS; i++) body(i);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / COST_CALLS;
+}
+
+int main() {
+  Accuracy accuracy = simulate();
+  printf("Position estimator (%d runs x %d steps, 4 beacons, %.0f dB RSSI noise)\n",
+         RUNS, STEPS, POSITION_RSSI_STDDEV_DB);
+  printf("  EKF mean position error      %6.0f mm\n", accuracy.position);
+  printf("  EKF mean heading error       %6.1f deg\n", accuracy.heading * 180.0 / M_PI);
+  printf("  single-round trilateration   %6.0f mm\n", accuracy.trilateration);
+
+  PositionEstimator estimator;
+  addBeacons(estimator);
+  std::mt19937 rng(1);
+  for (int b = 0; b < 4; b++) estimator.updateRssi(b + 1, rssiAt(2500, 2500, b, rng));
+
+  static float rssi[256];
+  for (float& value : rssi) value = rssiAt(2500, 2500, 0, rng);
+  double update = nsPerCall([&](int i) { estimator.updateRssi(1 + (i & 3), rssi[i & 255]); });
+  double predict = nsPerCall([&](int i) { estimator.predict((i & 1) ? 10.0f : 0.0f, (i & 1) ? 0.0f : 0.01f); });
+  printf("  updateRssi                   %6.0f ns/call (host)\n", update);
+  printf("  predict                      %6.0f ns/call (host)\n", predict);
+
+  // Filtering has to beat fixing each round from scratch
+  CHECK(accuracy.position < accuracy.trilateration);
+  TEST_MAIN_END();
+}
@@ -0,0 +1,212 @@
+/*
+ * Arduino.h (host)
+ * Minimal Arduino/ESP32 core for compiling firmware modules on the host
+ *
+ * Time is simulated: tests advance host::nowMicros explicitly. GPIO and
+ * LEDC calls are no-ops. Serial output is discarded unless HOST_VERBOSE
+ * is set in the environment.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define HIGH      1
+#define LOW       0
+#define INPUT     0
+#define OUTPUT    1
+#define RISING    1
+#define FALLING   2
+#define CHANGE    3
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#define DEG_TO_RAD  0.017453292519943295769236907684886
+#define RAD_TO_DEG  57.295779513082320876798154814105
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+namespace host {
+  extern uint64_t nowMicros;
+  inline void advanceMillis(unsigned long ms) { nowMicros += (uint64_t)ms * 1000; }
+  inline void setMillis(unsigned long ms) { nowMicros = (uint64_t)ms * 1000; }
+  bool verbose();
+
+  // Called on every millis(); lets a test interrupt code between reads
+  // of the clock (e.g. simulate a reset in the middle of a write)
+  inline void (*millisHook)() = nullptr;
+}
+
+inline unsigned long millis() {
+  if (host::millisHook != nullptr) host::millisHook();
+  return (unsigned long)(host::nowMicros / 1000);
+}
+inline unsigned long micros() { return (unsigned long)host::nowMicros; }
+inline void delay(unsigned long ms) { host::advanceMillis(ms); }
+inline void delayMicroseconds(unsigned int us) { host::nowMicros += us; }
+
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return 0; }
+inline bool ledcAttach(int, int, int) { return true; }
+inline bool ledcWrite(int, int) { return true; }
+inline bool ledcDetach(int) { return true; }
+inline uint32_t analogReadMilliVolts(int) { return 3700; }
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterruptArg(int, void (*)(void*), void*, int) {}
+
+// FreeRTOS
+typedef void* TaskHandle_t;
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+namespace host { extern TaskHandle_t currentTask; }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return host::currentTask; }
+inline unsigned uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+
+// Single-threaded recursive mutex; host::semaphoresHeld counts takes
+// not given back yet, so tests can check that every path releases
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdTRUE  1
+#define pdFALSE 0
+namespace host { inline int semaphoresHeld = 0; }
+struct HostSemaphore { int depth = 0; };
+typedef HostSemaphore* SemaphoreHandle_t;
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new HostSemaphore(); }
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t) {
+  mutex->depth++;
+  host::semaphoresHeld++;
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex) {
+  if (mutex->depth == 0) return pdFALSE;
+  mutex->depth--;
+  host::semaphoresHeld--;
+  return pdTRUE;
+}
+
+struct EspClass {
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+  void restart() { restarts++; }
+  int restarts = 0;
+};
+extern EspClass ESP;
+
+class String {
+public:
+  String() {}
+  String(const char* text) : s(text ? text : "") {}
+  String(const std::string& text) : s(text) {}
+  String(char c) : s(1, c) {}
+  String(int value) : s(std::to_string(value)) {}
+  String(unsigned int value) : s(std::to_string(value)) {}
+  String(long value) : s(std::to_string(value)) {}
+  String(unsigned long value) : s(std::to_string(value)) {}
+  String(float value, unsigned int decimals = 2) : s(format(value, decimals)) {}
+  String(double value, unsigned int decimals = 2) : s(format(value, decimals)) {}
+
+  unsigned int length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  char charAt(unsigned int index) const { return index < s.size() ? s[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+
+  String& operator+=(const String& other) { s += other.s; return *this; }
+  String& operator+=(const char* other) { s += other; return *this; }
+  String& operator+=(char other) { s += other; return *this; }
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator==(const char* other) const { return s == other; }
+
+  bool equalsIgnoreCase(const String& other) const {
+    if (s.size() != other.s.size()) return false;
+    for (size_t i = 0; i < s.size(); i++) {
+      if (tolower((unsigned char)s[i]) != tolower((unsigned char)other.s[i])) return false;
+    }
+    return true;
+  }
+  bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t pos = s.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+  String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < s.size() && to > from ? String(s.substr(from, to - from)) : String();
+  }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  void trim() {
+    size_t first = s.find_first_not_of(" \t\r\n");
+    size_t last = s.find_last_not_of(" \t\r\n");
+    s = (first == std::string::npos) ? "" : s.substr(first, last - first + 1);
+  }
+  void toUpperCase() { for (char& c : s) c = toupper((unsigned char)c); }
+  void toLowerCase() { for (char& c : s) c = tolower((unsigned char)c); }
+
+private:
+  std::string s;
+
+  static std::string format(double value, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    return buffer;
+  }
+};
+
+inline String operator+(const String& a, const String& b) { String r = a; r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r = a; r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+
+class HardwareSerial {
+public:
+  void begin(unsigned long) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  String readStringUntil(char) { return String(); }
+
+  size_t write(const uint8_t* data, size_t length) {
+    if (host::verbose()) fwrite(data, 1, length, stdout);
+    return length;
+  }
+  void print(const String& text) { out(text.c_str()); }
+  void print(const char* text) { out(text); }
+  void println() { out("\n"); }
+  void println(const String& text) { out(text.c_str()); out("\n"); }
+  void println(const char* text) { out(text); out("\n"); }
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    if (!host::verbose()) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+  }
+
+private:
+  void out(const char* text) { if (host::verbose()) fputs(text, stdout); }
+};
+extern HardwareSerial Serial;
+
+#endif // HOST_ARDUINO_H
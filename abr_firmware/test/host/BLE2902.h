@@ -0,0 +1 @@
+#include <BLEDevice.h>
@@ -0,0 +1,142 @@
+/*
+ * BLEDevice.h (host)
+ * Inert BLE stack so modules that include ble_manager.h compile on the
+ * host; tests replace BLEManager methods with link-time fakes
+ */
+
+#ifndef HOST_BLE_DEVICE_H
+#define HOST_BLE_DEVICE_H
+
+#include <Arduino.h>
+
+typedef uint8_t esp_bd_addr_t[6];
+
+struct esp_ble_gatts_cb_param_t {
+  struct {
+    uint16_t conn_id;
+    esp_bd_addr_t remote_bda;
+  } connect;
+};
+
+#define ESP_GATT_PERM_READ              (1 << 0)
+#define ESP_GATT_PERM_READ_ENCRYPTED    (1 << 1)
+#define ESP_GATT_PERM_READ_ENC_MITM     (1 << 2)
+#define ESP_GATT_PERM_WRITE             (1 << 4)
+#define ESP_GATT_PERM_WRITE_ENCRYPTED   (1 << 5)
+#define ESP_GATT_PERM_WRITE_ENC_MITM    (1 << 6)
+
+#define ESP_LE_AUTH_REQ_SC_BOND         0x09
+#define ESP_LE_AUTH_REQ_SC_MITM_BOND    0x0D
+#define ESP_IO_CAP_OUT                  0
+#define ESP_IO_CAP_NONE                 3
+#define ESP_BLE_ENC_KEY_MASK            (1 << 0)
+#define ESP_BLE_ID_KEY_MASK             (1 << 1)
+
+class BLEServer;
+class BLECharacteristic;
+
+class BLEServerCallbacks {
+public:
+  virtual ~BLEServerCallbacks() {}
+  virtual void onConnect(BLEServer*) {}
+  virtual void onConnect(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+  virtual void onDisconnect(BLEServer*) {}
+};
+
+class BLECharacteristicCallbacks {
+public:
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onWrite(BLECharacteristic*) {}
+};
+
+class BLEDescriptor {
+public:
+  virtual ~BLEDescriptor() {}
+  void setAccessPermissions(uint16_t permissions) { this->permissions = permissions; }
+  uint16_t permissions = 0;
+};
+class BLE2902 : public BLEDescriptor {};
+
+class BLECharacteristic {
+public:
+  enum {
+    PROPERTY_READ     = 1 << 0,
+    PROPERTY_WRITE    = 1 << 1,
+    PROPERTY_WRITE_NR = 1 << 2,
+    PROPERTY_NOTIFY   = 1 << 3
+  };
+
+  // Tests observe notifications through this hook
+  static inline void (*notifyHook)(BLECharacteristic* characteristic,
+                                   const uint8_t* data, size_t length) = nullptr;
+
+  void setCallbacks(BLECharacteristicCallbacks* callbacks) { this->callbacks = callbacks; }
+  void setAccessPermissions(uint16_t permissions) { this->permissions = permissions; }
+  void addDescriptor(BLEDescriptor*) {}
+  void setValue(const String& text) { value.assign(text.c_str(), text.length()); }
+  void setValue(uint8_t* data, size_t length) { value.assign((const char*)data, length); }
+  void notify() {
+    if (notifyHook != nullptr) notifyHook(this, getData(), getLength());
+  }
+  String getValue() { return String(value); }
+  uint8_t* getData() { return (uint8_t*)value.data(); }
+  size_t getLength() { return value.size(); }
+
+  // Simulate a client write
+  void write(const uint8_t* data, size_t length) {
+    value.assign((const char*)data, length);
+    if (callbacks != nullptr) callbacks->onWrite(this);
+  }
+
+  uint16_t permissions = 0;
+
+private:
+  std::string value;
+  BLECharacteristicCallbacks* callbacks = nullptr;
+};
+
+class BLEService {
+public:
+  BLECharacteristic* createCharacteristic(const char*, uint32_t) { return new BLECharacteristic(); }
+  void start() {}
+};
+
+class BLEServer {
+public:
+  void setCallbacks(BLEServerCallbacks*) {}
+  BLEService* createService(const char*) { return new BLEService(); }
+  void startAdvertising() {}
+  void updateConnParams(esp_bd_addr_t, uint16_t, uint16_t, uint16_t, uint16_t) {}
+  uint16_t getConnId() { return 0; }
+  uint16_t getPeerMTU(uint16_t) { return peerMtu; }
+
+  static inline uint16_t peerMtu = 23;
+};
+
+class BLEAdvertising {
+public:
+  void addServiceUUID(const char*) {}
+  void setScanResponse(bool) {}
+  void setMinPreferred(int) {}
+  void setMaxPreferred(int) {}
+};
+
+class BLESecurity {
+public:
+  void setAuthenticationMode(int) {}
+  void setCapability(int) {}
+  void setStaticPIN(uint32_t) {}
+  void setInitEncryptionKey(uint8_t) {}
+  void setRespEncryptionKey(uint8_t) {}
+};
+
+class BLEDevice {
+public:
+  static void init(const char*) {}
+  static BLEServer* createServer() { return new BLEServer(); }
+  static BLEAdvertising* getAdvertising() { return new BLEAdvertising(); }
+  static void startAdvertising() {}
+  static int setMTU(uint16_t) { return 0; }
+};
+
+#endif // HOST_BLE_DEVICE_H
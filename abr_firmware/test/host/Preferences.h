@@ -0,0 +1,43 @@
+/*
+ * Preferences.h (host)
+ * In-memory NVS; contents survive for the lifetime of the test process
+ */
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class Preferences {
+public:
+  bool begin(const char* name, bool = false) { space = name; return true; }
+  void end() {}
+
+  size_t getBytesLength(const char* key) {
+    auto it = storage.find(space + "/" + key);
+    return it == storage.end() ? 0 : it->second.size();
+  }
+  size_t getBytes(const char* key, void* buffer, size_t length) {
+    auto it = storage.find(space + "/" + key);
+    if (it == storage.end()) return 0;
+    length = min(length, it->second.size());
+    memcpy(buffer, it->second.data(), length);
+    return length;
+  }
+  size_t putBytes(const char* key, const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    storage[space + "/" + key].assign(bytes, bytes + length);
+    writes++;
+    return length;
+  }
+
+  static std::map<std::string, std::vector<uint8_t>> storage;
+  static inline int writes = 0;
+
+private:
+  std::string space;
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,37 @@
+/*
+ * Update.h (host)
+ * OTA updater that collects the image in memory
+ */
+
+#ifndef HOST_UPDATE_H
+#define HOST_UPDATE_H
+
+#include <Arduino.h>
+#include <vector>
+
+class UpdateClass {
+public:
+  bool begin(size_t size) { image.clear(); expected = size; running = true; return true; }
+  size_t write(uint8_t* data, size_t length) {
+    if (!running) return 0;
+    image.insert(image.end(), data, data + length);
+    return length;
+  }
+  bool end(bool evenIfRemaining = false) {
+    bool ok = running && (evenIfRemaining || image.size() == expected);
+    running = false;
+    finished = ok;
+    return ok;
+  }
+  void abort() { running = false; image.clear(); }
+  bool isRunning() { return running; }
+  const char* errorString() { return "host"; }
+
+  std::vector<uint8_t> image;
+  size_t expected = 0;
+  bool running = false;
+  bool finished = false;
+};
+extern UpdateClass Update;
+
+#endif // HOST_UPDATE_H
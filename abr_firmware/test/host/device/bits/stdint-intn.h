@@ -0,0 +1,16 @@
+/*
+ * bits/stdint-intn.h (device types)
+ * int32_t is long on the ESP32 toolchains
+ */
+
+#ifndef _BITS_STDINT_INTN_H
+#define _BITS_STDINT_INTN_H 1
+
+#include <bits/types.h>
+
+typedef __int8_t int8_t;
+typedef __int16_t int16_t;
+typedef long int32_t;
+typedef __int64_t int64_t;
+
+#endif // _BITS_STDINT_INTN_H
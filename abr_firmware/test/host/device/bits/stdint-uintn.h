@@ -0,0 +1,17 @@
+/*
+ * bits/stdint-uintn.h (device types)
+ * ESP32 toolchains define uint32_t as unsigned long, distinct from the
+ * unsigned int size_t; mirror that for the 32-bit type check
+ */
+
+#ifndef _BITS_STDINT_UINTN_H
+#define _BITS_STDINT_UINTN_H 1
+
+#include <bits/types.h>
+
+typedef __uint8_t uint8_t;
+typedef __uint16_t uint16_t;
+typedef unsigned long uint32_t;
+typedef __uint64_t uint64_t;
+
+#endif // _BITS_STDINT_UINTN_H
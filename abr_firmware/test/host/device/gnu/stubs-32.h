@@ -0,0 +1,5 @@
+/*
+ * gnu/stubs-32.h (device types)
+ * Lets the 32-bit type check run without the i386 glibc development
+ * package; nothing is linked
+ */
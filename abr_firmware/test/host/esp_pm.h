@@ -0,0 +1,4 @@
+#ifndef HOST_ESP_PM_H
+#define HOST_ESP_PM_H
+// CONFIG_PM_ENABLE is unset on the host; light sleep is compiled out
+#endif // HOST_ESP_PM_H
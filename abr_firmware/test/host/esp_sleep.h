@@ -0,0 +1,4 @@
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+inline int esp_sleep_enable_uart_wakeup(int) { return 0; }
+#endif // HOST_ESP_SLEEP_H
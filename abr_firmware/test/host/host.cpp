@@ -0,0 +1,25 @@
+/*
+ * host.cpp
+ * Globals behind the host Arduino core
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <Update.h>
+#include <esp_system.h>
+
+namespace host {
+  uint64_t nowMicros = 0;
+  esp_reset_reason_t resetReason = ESP_RST_POWERON;
+  TaskHandle_t currentTask = nullptr;
+
+  bool verbose() {
+    static const bool enabled = getenv("HOST_VERBOSE") != nullptr;
+    return enabled;
+  }
+}
+
+HardwareSerial Serial;
+EspClass ESP;
+UpdateClass Update;
+std::map<std::string, std::vector<uint8_t>> Preferences::storage;
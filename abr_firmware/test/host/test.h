@@ -0,0 +1,49 @@
+/*
+ * test.h (host)
+ * Minimal assertion helpers for the host tests
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %s (%lld vs %lld)\n", \
+              __FILE__, __LINE__, #a, #b, _a, _b); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+    double _a = (a), _b = (b); \
+    if (fabs(_a - _b) > (tol)) { \
+      fprintf(stderr, "%s:%d: CHECK_NEAR failed: %s ~ %s (%g vs %g)\n", \
+              __FILE__, __LINE__, #a, #b, _a, _b); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define TEST_MAIN_END() do { \
+    if (testFailures) { \
+      fprintf(stderr, "%d check(s) failed\n", testFailures); \
+      return 1; \
+    } \
+    printf("%s: ok\n", __FILE__); \
+    return 0; \
+  } while (0)
+
+#endif // HOST_TEST_H
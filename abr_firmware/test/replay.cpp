@@ -0,0 +1,61 @@
+/*
+ * replay.cpp
+ * Off-device session replay
+ *
+ * Replays a capture dumped with "capture dump" (CAP lines; anything else
+ * in the log is ignored) through the firmware command path on the host
+ * and prints the same report as the on-device "replay" command. Exits
+ * non-zero if the outputs diverge from the capture.
+ *
+ *   make replay CAPTURE=session.log
+ *
+ * Moves are planned with the calibration saved in the capture (CAP CAL
+ * lines); dumps without one fall back to the default calibration.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "session_replay.h"
+
+static MotorControl motors;
+static MotionModel motion;
+static CommandInterface commands(&motors, &motion);
+static BLEManager ble(&commands);
+static SessionReplay replay(&motors, &motion, &commands, &ble);
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <capture log>\n", argv[0]);
+    return 2;
+  }
+
+  FILE* file = fopen(argv[1], "r");
+  if (file == nullptr) {
+    perror(argv[1]);
+    return 2;
+  }
+
+  // The report goes through Serial
+  setenv("HOST_VERBOSE", "1", 1);
+
+  char line[512];
+  size_t lineNumber = 0;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    lineNumber++;
+    line[strcspn(line, "\r\n")] = '\0';
+    const char* start = strstr(line, CAPTURE_LINE_PREFIX);
+    if (start == nullptr) continue;
+    if (!capture.load(String(start))) {
+      fprintf(stderr, "%s:%zu: malformed capture record\n", argv[1], lineNumber);
+      fclose(file);
+      return 2;
+    }
+  }
+  fclose(file);
+
+  motors.begin();
+  motors.setOutputObserver(SessionCapture::recordOutput);
+  motion.resetCalibration();
+  return replay.run(capture) ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+/*
+ * test_bulk_transfer.cpp
+ * Bulk channel over a simulated link: framing, CRC, window, OTA checks,
+ * motion hold during uploads
+ *
+ * Rover frames are captured from the notify hook; client frames go in
+ * through onReceive() as the BLE task delivers them. The loop ticks every
+ * 10 ms, so the download figure is the throughput the protocol allows at
+ * that tick rate, not radio throughput.
+ */
+
+#include <vector>
+#include "test.h"
+#include "bulk_transfer.h"
+#include <Update.h>
+
+#define TICK_MS      10
+#define SOURCE_SIZE  20000
+
+typedef std::vector<uint8_t> Frame;
+
+static MotorControl motors;
+static MotionModel motion;
+static CommandInterface commands(&motors, &motion);
+static BLEManager ble(&commands);
+static BulkTransfer bulk(&ble, &motors);
+
+static std::vector<Frame> received;    // Rover -> client
+
+static bool motionAllowed() { return !bulk.isUpdating(); }
+static uint8_t sourceData[SOURCE_SIZE];
+
+static void onNotify(BLECharacteristic*, const uint8_t* data, size_t length) {
+  // Status notifications are text and never look like a bulk frame
+  BulkHeader header;
+  if (length < BULK_HEADER_SIZE) return;
+  memcpy(&header, data, BULK_HEADER_SIZE);
+  if (header.length != length - BULK_HEADER_SIZE) return;
+  received.push_back(Frame(data, data + length));
+}
+
+static size_t sourceSize() { return SOURCE_SIZE; }
+
+static size_t sourceRead(uint32_t offset, uint8_t* buffer, size_t length) {
+  memcpy(buffer, sourceData + offset, length);
+  return length;
+}
+
+static BulkHeader headerOf(const Frame& frame) {
+  BulkHeader header;
+  memcpy(&header, frame.data(), BULK_HEADER_SIZE);
+  return header;
+}
+
+static void clientSend(BulkOp op, uint8_t stream, uint32_t offset, uint16_t param,
+                       const uint8_t* payload = nullptr, uint16_t length = 0) {
+  Frame frame(BULK_HEADER_SIZE + length);
+  BulkHeader header = {op, stream, length, offset, 0, param};
+  if (length > 0) {
+    header.crc = BulkTransfer::crc16(payload, length);
+    memcpy(frame.data() + BULK_HEADER_SIZE, payload, length);
+  }
+  memcpy(frame.data(), &header, BULK_HEADER_SIZE);
+  bulk.onReceive(frame.data(), frame.size());
+}
+
+static void tick() {
+  host::advanceMillis(TICK_MS);
+  bulk.update(millis());
+}
+
+// Pops the next rover frame, or returns false
+static bool next(Frame& frame) {
+  if (received.empty()) return false;
+  frame = received.front();
+  received.erase(received.begin());
+  return true;
+}
+
+static void testCrc() {
+  // CRC-16/CCITT-FALSE check value
+  CHECK_EQ(BulkTransfer::crc16((const uint8_t*)"123456789", 9), 0x29B1);
+}
+
+static void testDownload() {
+  const uint16_t window = 4;
+  received.clear();
+  clientSend(BULK_OP_OPEN_READ, BULK_STREAM_CAPTURE, 0, window);
+  tick();
+
+  Frame frame;
+  CHECK(next(frame));
+  BulkHeader info = headerOf(frame);
+  CHECK_EQ(info.op, BULK_OP_INFO);
+  CHECK_EQ(info.offset, SOURCE_SIZE);
+  CHECK_EQ(info.param, BULK_MAX_PAYLOAD);
+  uint32_t windowBytes = window * info.param;
+
+  std::vector<uint8_t> data;
+  bool dropped = false, corrupted = false, ended = false;
+  int nakCount = 0, ticks = 0;
+  while (!ended && ticks < 1000) {
+    tick();
+    ticks++;
+    while (next(frame)) {
+      BulkHeader header = headerOf(frame);
+      if (header.op == BULK_OP_END) {
+        CHECK_EQ(header.offset, SOURCE_SIZE);
+        ended = true;
+        break;
+      }
+      CHECK_EQ(header.op, BULK_OP_DATA);
+      CHECK(header.offset + header.length <= data.size() + windowBytes);
+
+      // Lose one block and corrupt another on the way
+      if (!dropped && header.offset == 3 * info.param) {
+        dropped = true;
+        continue;
+      }
+      if (!corrupted && header.offset == 40 * info.param) {
+        corrupted = true;
+        frame[BULK_HEADER_SIZE] ^= 0xFF;
+      }
+
+      const uint8_t* payload = frame.data() + BULK_HEADER_SIZE;
+      if (header.offset != data.size() ||
+          BulkTransfer::crc16(payload, header.length) != header.crc) {
+        // Stale blocks behind a gap are NAKed once per gap
+        if (header.offset > data.size()) {
+          clientSend(BULK_OP_NAK, BULK_STREAM_CAPTURE, data.size(), 0);
+          nakCount++;
+          while (next(frame)) {}
+        } else if (header.offset == data.size()) {
+          clientSend(BULK_OP_NAK, BULK_STREAM_CAPTURE, data.size(), 0);
+          nakCount++;
+        }
+        break;
+      }
+      data.insert(data.end(), payload, payload + header.length);
+      clientSend(BULK_OP_ACK, BULK_STREAM_CAPTURE, data.size(), 0);
+    }
+  }
+
+  CHECK(ended);
+  CHECK(dropped && corrupted);
+  CHECK(nakCount >= 2);
+  CHECK(!bulk.isActive());
+  CHECK_EQ(data.size(), SOURCE_SIZE);
+  CHECK(memcmp(data.data(), sourceData, SOURCE_SIZE) == 0);
+
+  double seconds = ticks * TICK_MS / 1000.0;
+  printf("Bulk download: %d bytes in %d ticks of %d ms, %.1f KiB/s (2 resends)\n",
+         SOURCE_SIZE, ticks, TICK_MS, SOURCE_SIZE / seconds / 1024.0);
+}
+
+static void testDownloadTimeout() {
+  received.clear();
+  clientSend(BULK_OP_OPEN_READ, BULK_STREAM_CAPTURE, 1000, 2);
+  tick();
+  Frame frame;
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_INFO);
+
+  // Silent client: two blocks, then nothing until the ACK timeout
+  tick();
+  tick();
+  CHECK_EQ(received.size(), 2);
+  CHECK_EQ(headerOf(received[0]).offset, 1000);
+  received.clear();
+  for (int t = 0; t < BULK_ACK_TIMEOUT_MS / TICK_MS + 1; t++) tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).offset, 1000);
+
+  clientSend(BULK_OP_ABORT, BULK_STREAM_CAPTURE, 0, 0);
+  tick();
+  CHECK(!bulk.isActive());
+}
+
+struct Image {
+  std::vector<uint8_t> data;
+  uint8_t open[4 + BULK_OTA_HASH_SIZE];
+};
+
+static Image makeImage(size_t size, bool badHash) {
+  Image image;
+  for (size_t i = 0; i < size; i++) image.data.push_back((uint8_t)(i * 7 + 3));
+  uint32_t length = size;
+  memcpy(image.open, &length, sizeof(length));
+  mbedtls_sha256(image.data.data(), size, image.open + 4, 0);
+  if (badHash) image.open[4] ^= 0x01;
+  return image;
+}
+
+static void sendBlock(const Image& image, uint32_t offset) {
+  uint16_t length = std::min((size_t)BULK_MAX_PAYLOAD, image.data.size() - offset);
+  clientSend(BULK_OP_DATA, BULK_STREAM_OTA, offset, 0, image.data.data() + offset, length);
+}
+
+// Opens an upload and streams the image, keeping the advertised window full
+static void upload(const Image& image) {
+  received.clear();
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, 0, 0, image.open, sizeof(image.open));
+  tick();
+  Frame frame;
+  CHECK(next(frame));
+  BulkHeader accept = headerOf(frame);
+  CHECK_EQ(accept.op, BULK_OP_ACK);
+  CHECK_EQ(accept.param, BULK_RX_QUEUE);
+
+  uint32_t sent = 0, acked = 0;
+  while (acked < image.data.size()) {
+    // The whole window is queued before the loop runs
+    while (sent < image.data.size() && sent - acked < (uint32_t)accept.param * BULK_MAX_PAYLOAD) {
+      sendBlock(image, sent);
+      sent += std::min((size_t)BULK_MAX_PAYLOAD, image.data.size() - sent);
+    }
+    tick();
+    while (next(frame)) {
+      BulkHeader header = headerOf(frame);
+      CHECK_EQ(header.op, BULK_OP_ACK);
+      if (header.op != BULK_OP_ACK) return;
+      acked = header.offset;
+    }
+  }
+  CHECK_EQ(Update.image.size(), image.data.size());
+}
+
+static void testUpload() {
+  Image image = makeImage(5000, false);
+  int restarts = ESP.restarts;
+  upload(image);
+
+  clientSend(BULK_OP_END, BULK_STREAM_OTA, 0, 0);
+  tick();
+  Frame frame;
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_END);
+  CHECK(Update.finished);
+  CHECK(Update.image == image.data);
+
+  // Motors stay held until the reboot
+  CHECK(bulk.isUpdating());
+  motors.forward(200);
+  CHECK(!motors.isMoving());
+
+  // Reboot after the delay, and not while the motors run
+  CHECK_EQ(ESP.restarts, restarts);
+  motors.setMotionGuard(nullptr);
+  motors.forward(200);
+  for (int t = 0; t < 2 * BULK_REBOOT_DELAY_MS / TICK_MS; t++) tick();
+  CHECK_EQ(ESP.restarts, restarts);
+  motors.stop();
+  tick();
+  CHECK_EQ(ESP.restarts, restarts + 1);
+  CHECK(!bulk.isUpdating());
+  motors.setMotionGuard(motionAllowed);
+}
+
+static void testMotionHeld() {
+  Image image = makeImage(2000, false);
+  received.clear();
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, 0, 0, image.open, sizeof(image.open));
+  tick();
+  Frame frame;
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ACK);
+  sendBlock(image, 0);
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ACK);
+
+  // No direction moves while the image is written, and nothing is timed
+  CHECK(bulk.isUpdating());
+  commands.process(String("F:200:500"));
+  CHECK(!motors.isMoving());
+  commands.process(String("B:200"));
+  CHECK(!motors.isMoving());
+  commands.process(String("J:0:-80"));
+  CHECK(!motors.isMoving());
+
+  // A vanished client releases the motors; reopening holds them again
+  ble.onDisconnect(nullptr);
+  tick();
+  CHECK(!bulk.isUpdating());
+  commands.process(String("B:200"));
+  CHECK(motors.isMoving());
+  commands.process(String("S"));
+
+  ble.onConnect(nullptr);
+  received.clear();
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, BULK_MAX_PAYLOAD, 0, image.open, sizeof(image.open));
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ACK);
+  CHECK(bulk.isUpdating());
+  motors.rotateLeft(200);
+  CHECK(!motors.isMoving());
+
+  clientSend(BULK_OP_ABORT, BULK_STREAM_OTA, 0, 0);
+  tick();
+  CHECK(!bulk.isUpdating());
+  motors.rotateLeft(200);
+  CHECK(motors.isMoving());
+  motors.stop();
+}
+
+static void testUploadRejected() {
+  Frame frame;
+  int restarts = ESP.restarts;
+
+  // Wrong hash: the image is refused and the update aborted
+  Update.finished = false;
+  Image bad = makeImage(3000, true);
+  upload(bad);
+  clientSend(BULK_OP_END, BULK_STREAM_OTA, 0, 0);
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ERROR);
+  CHECK(!Update.finished);
+  CHECK(!Update.isRunning());
+  for (int t = 0; t < 2 * BULK_REBOOT_DELAY_MS / TICK_MS; t++) tick();
+  CHECK_EQ(ESP.restarts, restarts);
+
+  // No upload while moving
+  Image image = makeImage(3000, false);
+  motors.forward(200);
+  received.clear();
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, 0, 0, image.open, sizeof(image.open));
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ERROR);
+  CHECK(!Update.isRunning());
+  motors.stop();
+
+  // Too short an OPEN_WRITE (no hash)
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, 0, 0, image.open, 4);
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ERROR);
+}
+
+static void testUploadErrors() {
+  Image image = makeImage(2000, false);
+  received.clear();
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, 0, 0, image.open, sizeof(image.open));
+  tick();
+  Frame frame;
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_ACK);
+
+  // Corrupt block: NAK with what is held
+  Frame corrupt(BULK_HEADER_SIZE + 100);
+  BulkHeader header = {BULK_OP_DATA, BULK_STREAM_OTA, 100, 0,
+                       BulkTransfer::crc16(image.data.data(), 100), 0};
+  memcpy(corrupt.data(), &header, BULK_HEADER_SIZE);
+  memcpy(corrupt.data() + BULK_HEADER_SIZE, image.data.data(), 100);
+  corrupt[BULK_HEADER_SIZE + 5] ^= 0x10;
+  bulk.onReceive(corrupt.data(), corrupt.size());
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_NAK);
+  CHECK_EQ(headerOf(frame).offset, 0);
+
+  // Overrunning the ring: frames past the free slots are dropped and
+  // the client is told where to resume
+  for (int i = 0; i < BULK_RX_FRAMES + 2; i++) sendBlock(image, 0);
+  tick();
+  int acks = 0, naks = 0;
+  while (next(frame)) {
+    if (headerOf(frame).op == BULK_OP_ACK) acks++;
+    if (headerOf(frame).op == BULK_OP_NAK) naks++;
+    if (headerOf(frame).op == BULK_OP_NAK) CHECK_EQ(headerOf(frame).offset, BULK_MAX_PAYLOAD);
+  }
+  CHECK_EQ(acks, BULK_RX_FRAMES - 1);
+  CHECK_EQ(naks, 1);
+
+  // Disconnect and resume with the same image
+  clientSend(BULK_OP_OPEN_WRITE, BULK_STREAM_OTA, 0, 0, image.open, sizeof(image.open));
+  tick();
+  CHECK(next(frame));
+  CHECK_EQ(headerOf(frame).op, BULK_OP_NAK);
+  CHECK_EQ(headerOf(frame).offset, BULK_MAX_PAYLOAD);
+
+  clientSend(BULK_OP_ABORT, BULK_STREAM_OTA, 0, 0);
+  tick();
+  CHECK(!Update.isRunning());
+  CHECK(!bulk.isActive());
+}
+
+int main() {
+  for (size_t i = 0; i < SOURCE_SIZE; i++) sourceData[i] = (uint8_t)(i ^ (i >> 8));
+
+  motors.begin();
+  motors.setMotionGuard(motionAllowed);
+  ble.begin();
+  ble.onConnect(nullptr);
+  BLEServer::peerMtu = BLE_MAX_MTU;
+  BLECharacteristic::notifyHook = onNotify;
+  bulk.begin();
+  bulk.registerSource({BULK_STREAM_CAPTURE, sourceSize, sourceRead});
+  host::setMillis(0);
+
+  testCrc();
+  testDownload();
+  testDownloadTimeout();
+  testUpload();
+  testUploadRejected();
+  testUploadErrors();
+  testMotionHeld();
+  TEST_MAIN_END();
+}
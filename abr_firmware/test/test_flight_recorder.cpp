@@ -0,0 +1,169 @@
+/*
+ * test_flight_recorder.cpp
+ * Ring wraparound across a reset, torn records and reset reason names
+ *
+ * The RTC ring is a static in flight_recorder.cpp and outlives any one
+ * FlightRecorder; a new recorder calling begin() is a reboot.
+ */
+
+#include <vector>
+#include "test.h"
+#include "command_interface.h"
+#include "flight_recorder.h"
+#include <esp_system.h>
+
+struct Preserved {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t reason;
+  std::vector<FlightRecord> records;
+};
+
+static Preserved readPrevious(const FlightRecorder& recorder) {
+  std::vector<uint8_t> bytes(recorder.byteSize());
+  CHECK_EQ(recorder.readBytes(0, bytes.data(), bytes.size()), bytes.size());
+
+  Preserved preserved = {};
+  if (bytes.size() < offsetof(FlightLog, records)) return preserved;
+  memcpy(&preserved.magic, bytes.data() + offsetof(FlightLog, magic), 4);
+  memcpy(&preserved.count, bytes.data() + offsetof(FlightLog, next), 4);
+  memcpy(&preserved.reason, bytes.data() + offsetof(FlightLog, resetReason), 4);
+  preserved.records.resize(preserved.count);
+  memcpy(preserved.records.data(), bytes.data() + offsetof(FlightLog, records),
+         preserved.count * sizeof(FlightRecord));
+  return preserved;
+}
+
+static void boot(FlightRecorder& recorder, esp_reset_reason_t reason) {
+  host::resetReason = reason;
+  recorder.begin();
+}
+
+static void testReasonNames() {
+  CHECK(strcmp(FlightRecorder::reasonName(ESP_RST_UNKNOWN), "UNKNOWN") == 0);
+  CHECK(strcmp(FlightRecorder::reasonName(ESP_RST_EXT), "EXTERNAL") == 0);
+  CHECK(strcmp(FlightRecorder::reasonName(ESP_RST_CPU_LOCKUP), "CPU_LOCKUP") == 0);
+  for (int reason = ESP_RST_POWERON; reason <= ESP_RST_CPU_LOCKUP; reason++) {
+    CHECK(strcmp(FlightRecorder::reasonName(reason), "UNKNOWN") != 0);
+  }
+}
+
+static void testWraparound() {
+  host::setMillis(0);
+  FlightRecorder first;
+  boot(first, ESP_RST_POWERON);
+  CHECK(!first.hasPrevious());
+
+  // Boot record, one motor state, 300 commands, final motor state:
+  // 303 records through a 256-slot ring
+  first.recordMotor(1, 200, 1, 200);
+  for (int i = 0; i < 300; i++) {
+    host::advanceMillis(1);
+    first.recordCommand(1, (int16_t)i, 0, 0);
+  }
+  host::advanceMillis(1);
+  first.recordMotor(1, 180, 2, 180);
+
+  FlightRecorder second;
+  boot(second, ESP_RST_PANIC);
+  CHECK(second.hasPrevious());
+  CHECK_EQ(second.previousResetReason(), ESP_RST_PANIC);
+  CHECK_EQ(second.previousCount(), FLIGHT_RECORDS);
+
+  Preserved preserved = readPrevious(second);
+  CHECK_EQ(preserved.magic, FLIGHT_MAGIC);
+  CHECK_EQ(preserved.count, FLIGHT_RECORDS);
+  CHECK_EQ(preserved.reason, ESP_RST_PANIC);
+
+  // Oldest surviving record first, in claim order
+  const std::vector<FlightRecord>& records = preserved.records;
+  CHECK_EQ(records.front().type, FLIGHT_COMMAND);
+  CHECK_EQ(records.front().value, 303 - FLIGHT_RECORDS - 2);
+  for (size_t i = 1; i < records.size(); i++) {
+    CHECK_EQ(records[i].seq, (uint16_t)(records[i - 1].seq + 1));
+    CHECK(records[i].timeMs >= records[i - 1].timeMs);
+  }
+  const FlightRecord& last = records.back();
+  CHECK_EQ(last.type, FLIGHT_MOTOR);
+  CHECK_EQ(last.data[1], 180);
+  CHECK(last.flags & FLIGHT_FLAG_LAST_MOTOR);
+  CHECK_EQ(records[records.size() - 2].value, 299);
+
+  // The second run starts from an empty ring
+  FlightRecorder third;
+  boot(third, ESP_RST_TASK_WDT);
+  Preserved secondRun = readPrevious(third);
+  CHECK_EQ(secondRun.count, 1);
+  CHECK_EQ(secondRun.records[0].type, FLIGHT_BOOT);
+  CHECK_EQ(secondRun.records[0].value, ESP_RST_PANIC);
+
+  // Power-on retains nothing
+  FlightRecorder cold;
+  boot(cold, ESP_RST_POWERON);
+  CHECK(!cold.hasPrevious());
+  CHECK_EQ(cold.byteSize(), 0);
+}
+
+static FlightRecorder* afterReset = nullptr;
+
+static void resetNow() {
+  // First clock read inside write(): the record is claimed, not published
+  host::millisHook = nullptr;
+  afterReset = new FlightRecorder();
+  boot(*afterReset, ESP_RST_BROWNOUT);
+}
+
+static void testTornRecord() {
+  FlightRecorder run;
+  boot(run, ESP_RST_POWERON);
+  run.recordMotor(1, 200, 1, 200);
+  run.recordCommand(2, 500, 0, 0);
+
+  host::millisHook = resetNow;
+  run.recordMotor(0, 0, 0, 0);
+  CHECK(afterReset != nullptr);
+
+  // Boot, motor, command; the motor record cut by the reset is dropped
+  // and the last complete one is flagged
+  Preserved preserved = readPrevious(*afterReset);
+  CHECK_EQ(preserved.count, 3);
+  CHECK_EQ(preserved.records[1].type, FLIGHT_MOTOR);
+  CHECK_EQ(preserved.records[1].data[1], 200);
+  CHECK(preserved.records[1].flags & FLIGHT_FLAG_LAST_MOTOR);
+  CHECK_EQ(preserved.records[2].type, FLIGHT_COMMAND);
+  delete afterReset;
+}
+
+static void testDryRunNotRecorded() {
+  MotorControl motors;
+  MotionModel motion;
+  CommandInterface commands(&motors, &motion);
+  motors.begin();
+
+  boot(flight, ESP_RST_POWERON);
+  commands.process(String("V:200"));
+  motors.setDryRun(true);
+  commands.process(String("F:200:100"));
+  commands.process(String("Q"));
+  commands.process(String("@:1"));                  // Invalid
+  motors.stop();
+  motors.setDryRun(false);
+
+  FlightRecorder next;
+  boot(next, ESP_RST_SW);
+  Preserved preserved = readPrevious(next);
+  int commandRecords = 0;
+  for (const FlightRecord& record : preserved.records) {
+    if (record.type == FLIGHT_COMMAND) commandRecords++;
+    CHECK(record.type != FLIGHT_MOTOR);
+  }
+  CHECK_EQ(commandRecords, 1);
+}
+
+int main() {
+  testReasonNames();
+  testWraparound();
+  testTornRecord();
+  testDryRunNotRecorded();
+  TEST_MAIN_END();
+}
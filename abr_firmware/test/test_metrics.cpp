@@ -0,0 +1,96 @@
+/*
+ * test_metrics.cpp
+ * Histogram bucketing, per-task command latency and snapshot bounds
+ */
+
+#include "test.h"
+#include "metrics.h"
+
+static TaskHandle_t const LOOP_TASK = nullptr;
+static TaskHandle_t const BLE_TASK = (TaskHandle_t)0x1;
+
+static void testBuckets() {
+  Metrics m;
+  m.record(HIST_PARSE_US, 0);
+  m.record(HIST_PARSE_US, 1);
+  m.record(HIST_PARSE_US, 3);
+  m.record(HIST_PARSE_US, 1024);
+  m.record(HIST_PARSE_US, 0xFFFFFFFF);
+
+  const Histogram& h = m.getHistogram(HIST_PARSE_US);
+  CHECK_EQ(h.count, 5);
+  CHECK_EQ(h.buckets[0], 1);
+  CHECK_EQ(h.buckets[1], 1);
+  CHECK_EQ(h.buckets[2], 1);
+  CHECK_EQ(h.buckets[11], 1);
+  CHECK_EQ(h.buckets[HISTOGRAM_BUCKETS - 1], 1);   // Overflow
+  CHECK_EQ(h.max, 0xFFFFFFFF);
+}
+
+static void testOverlappingSources() {
+  Metrics m;
+  host::currentTask = BLE_TASK;
+  m.setBleTask(BLE_TASK);
+
+  // BLE write arrives, then a serial command before the BLE one actuates
+  host::nowMicros = 1000;
+  m.markCommandStart();
+  host::currentTask = LOOP_TASK;
+  host::nowMicros = 1500;
+  m.markCommandStart();
+
+  host::nowMicros = 1600;
+  m.markActuated();                      // Serial: 100 us
+  host::currentTask = BLE_TASK;
+  host::nowMicros = 5000;
+  m.markActuated();                      // BLE: 4000 us
+
+  const Histogram& h = m.getHistogram(HIST_COMMAND_LATENCY_US);
+  CHECK_EQ(h.count, 2);
+  CHECK_EQ(h.buckets[7], 1);             // 64 <= 100 < 128
+  CHECK_EQ(h.buckets[12], 1);            // 2048 <= 4000 < 4096
+  CHECK_EQ(h.max, 4000);
+
+  // A second actuation without a new command records nothing
+  m.markActuated();
+  CHECK_EQ(h.count, 2);
+
+  // Clearing one source leaves the other pending
+  host::nowMicros = 6000;
+  m.markCommandStart();
+  host::currentTask = LOOP_TASK;
+  m.markCommandStart();
+  m.clearCommandStart();
+  m.markActuated();
+  CHECK_EQ(h.count, 2);
+  host::currentTask = BLE_TASK;
+  host::nowMicros = 6010;
+  m.markActuated();
+  CHECK_EQ(h.count, 3);
+  host::currentTask = LOOP_TASK;
+}
+
+static void testSnapshot() {
+  Metrics m;
+  m.increment(CTR_COMMANDS, 7);
+  for (uint32_t v = 1; v != 0 && v < (1u << 30); v <<= 1) {
+    m.record(HIST_LOOP_PERIOD_US, v);
+  }
+
+  uint8_t buffer[METRICS_SNAPSHOT_MAX];
+  size_t length = m.snapshot(buffer, sizeof(buffer));
+  CHECK(length > 0);
+  CHECK(length <= METRICS_SNAPSHOT_MAX);
+  CHECK_EQ(buffer[0], METRICS_MAGIC);
+  CHECK_EQ(buffer[1], METRICS_VERSION);
+
+  // Too small a buffer is refused rather than truncated
+  CHECK_EQ(m.snapshot(buffer, length - 1), 0);
+}
+
+int main() {
+  testBuckets();
+  testOverlappingSources();
+  testSnapshot();
+  TEST_MAIN_END();
+}
@@ -0,0 +1,150 @@
+/*
+ * test_motion_model.cpp
+ * Move planning, online refinement, speed arguments and deferred persistence
+ */
+
+#include "test.h"
+#include "command_interface.h"
+#include <Preferences.h>
+
+static void testZeroIsNoOp() {
+  MotionModel motion;
+  motion.begin();
+  CHECK_EQ(motion.plan(MOTION_LINEAR, 0, 200).durationMs, 0);
+  CHECK_EQ(motion.plan(MOTION_ROTATION, 0, 185).durationMs, 0);
+  CHECK(motion.plan(MOTION_LINEAR, 1, 200).durationMs >= MOTION_MIN_DURATION_MS);
+
+  MotorControl motors;
+  CommandInterface commands(&motors, &motion);
+  commands.process(String("D:0:200"));
+  CHECK(!motors.isMoving());
+  commands.process(String("T:0"));
+  CHECK(!motors.isMoving());
+}
+
+static void testRefinement() {
+  MotionModel motion;
+  motion.begin();
+  motion.resetCalibration();
+  float otherLevel = motion.rate(MOTION_LINEAR, 240);
+
+  // Rover actually covers 0.8 mm/ms with 60 mm of coasting
+  for (int i = 0; i < 20; i++) {
+    uint16_t duration = 500 + (i % 4) * 400;
+    motion.addObservation(MOTION_LINEAR, 200, duration, 0.8f * duration + 60);
+  }
+  CHECK_NEAR(motion.rate(MOTION_LINEAR, 200), 0.8, 0.01);
+  CHECK_NEAR(motion.displacement(MOTION_LINEAR, 200, 1000), 860, 10);
+  CHECK_NEAR(motion.plan(MOTION_LINEAR, 1000, 200).durationMs, (1000 - 60) / 0.8, 15);
+
+  // Other speed levels are untouched
+  CHECK_NEAR(motion.rate(MOTION_LINEAR, 240), otherLevel, 0);
+}
+
+static void testFeedbackCommand() {
+  host::setMillis(0);
+  MotionModel motion;
+  motion.begin();
+  motion.resetCalibration();
+  MotorControl motors;
+  CommandInterface commands(&motors, &motion);
+  commands.setClock(millis);
+
+  float before = motion.rate(MOTION_LINEAR, 200);
+  commands.process(String("D:1000:200"));
+  CHECK(motors.isMoving());
+
+  // Feedback is refused while the move is still running
+  commands.process(String("K:700"));
+  CHECK_NEAR(motion.rate(MOTION_LINEAR, 200), before, 0);
+
+  host::advanceMillis(5000);
+  commands.update();
+  CHECK(!motors.isMoving());
+  commands.process(String("K:700"));
+  CHECK(motion.rate(MOTION_LINEAR, 200) < before);
+}
+
+static uint8_t appliedDuty = 0;
+
+static void onOutput(Direction, uint8_t leftDuty, Direction, uint8_t) {
+  appliedDuty = leftDuty;
+}
+
+static void testSpeedArguments() {
+  host::setMillis(0);
+  MotionModel motion;
+  motion.begin();
+  motion.resetCalibration();
+  MotorControl motors;
+  motors.setOutputObserver(onOutput);
+  CommandInterface commands(&motors, &motion);
+
+  // 300 clamps to MAX_SPEED rather than wrapping to 44
+  float slowest = motion.rate(MOTION_LINEAR, MIN_SPEED);
+  float fastest = motion.rate(MOTION_LINEAR, MAX_SPEED);
+  commands.process(String("F:300:500"));
+  CHECK_EQ(appliedDuty, MAX_SPEED);
+  host::advanceMillis(600);
+  commands.update();
+  commands.process(String("K:100"));
+  CHECK_NEAR(motion.rate(MOTION_LINEAR, MIN_SPEED), slowest, 0);
+  CHECK(motion.rate(MOTION_LINEAR, MAX_SPEED) < fastest);
+
+  commands.process(String("D:500:300"));
+  CHECK_EQ(appliedDuty, MAX_SPEED);
+  commands.process(String("S"));
+}
+
+static void testUntimedMoveEndsTimer() {
+  host::setMillis(0);
+  MotionModel motion;
+  motion.begin();
+  motion.resetCalibration();
+  MotorControl motors;
+  CommandInterface commands(&motors, &motion);
+
+  // An untimed pattern supersedes the timed move: the old timer no
+  // longer stops the rover, and feedback refers to the 300 ms driven
+  commands.process(String("F:200:1000"));
+  host::advanceMillis(300);
+  commands.process(String("L"));
+  host::advanceMillis(1000);
+  commands.update();
+  CHECK(motors.isMoving());
+
+  float before = motion.rate(MOTION_LINEAR, 200);
+  commands.process(String("K:300"));
+  CHECK_NEAR(motion.rate(MOTION_LINEAR, 200), before, 0.02);
+  commands.process(String("S"));
+}
+
+static void testDeferredSave() {
+  host::setMillis(0);
+  MotionModel motion;
+  motion.begin();
+  int writes = Preferences::writes;
+
+  motion.addObservation(MOTION_LINEAR, 200, 1000, 900);
+  motion.update(millis());
+  CHECK_EQ(Preferences::writes, writes);
+
+  host::advanceMillis(MOTION_SAVE_DELAY_MS + 1);
+  motion.update(millis());
+  CHECK_EQ(Preferences::writes, writes + 1);
+
+  // Reloaded from NVS
+  MotionModel reloaded;
+  reloaded.begin();
+  CHECK_NEAR(reloaded.rate(MOTION_LINEAR, 200), motion.rate(MOTION_LINEAR, 200), 1e-6);
+}
+
+int main() {
+  testZeroIsNoOp();
+  testRefinement();
+  testFeedbackCommand();
+  testSpeedArguments();
+  testUntimedMoveEndsTimer();
+  testDeferredSave();
+  TEST_MAIN_END();
+}
@@ -0,0 +1,170 @@
+/*
+ * test_obstacle_sensor.cpp
+ * Stopping distance, echo filtering, arming on the first reading,
+ * fail-closed guard and blocked moves
+ */
+
+#include <vector>
+#include "test.h"
+#include "command_interface.h"
+#include "obstacle_sensor.h"
+
+static MotorControl motors;
+static MotionModel motion;
+static CommandInterface commands(&motors, &motion);
+static ObstacleSensor obstacles(&motion);
+static std::vector<String> events;
+
+static bool guard(uint8_t duty) { return obstacles.isClear(duty); }
+static void onEvent(const String& event) { events.push_back(event); }
+
+static bool hasEvent(const char* event) {
+  for (const String& e : events) {
+    if (e == event) return true;
+  }
+  return false;
+}
+
+// One echo of the given pulse length, picked up by the next update()
+static void echo(uint8_t sensor, uint32_t pulseUs) {
+  uint32_t now = micros();
+  obstacles.onEchoEdge(sensor, true, now);
+  obstacles.onEchoEdge(sensor, false, now + pulseUs);
+  host::advanceMillis(ULTRASONIC_PERIOD_MS);
+  obstacles.update(millis());
+}
+
+static void echoMm(uint8_t sensor, float mm) {
+  echo(sensor, (uint32_t)lroundf(mm / 0.1715f));
+}
+
+static void testStoppingDistance() {
+  // Default model at duty 200 (level 201): 1.005 m/s, so 120.6 mm
+  // reaction, v^2 / 2a = 252.5 mm and the 50 mm margin
+  CHECK_NEAR(motion.rate(MOTION_LINEAR, DEFAULT_LINEAR_SPEED), 1.005, 1e-4);
+  CHECK_NEAR(obstacles.stoppingDistance(DEFAULT_LINEAR_SPEED), 423.1, 0.1);
+
+  for (uint8_t duty = MIN_SPEED; duty < MAX_SPEED; duty++) {
+    float v = motion.rate(MOTION_LINEAR, duty) * 1000.0f;
+    CHECK_NEAR(obstacles.stoppingDistance(duty),
+               v * 0.120f + v * v / (2.0f * OBSTACLE_DECEL_MM_S2) + OBSTACLE_MARGIN_MM, 0.01);
+    CHECK(obstacles.stoppingDistance(duty + 1) >= obstacles.stoppingDistance(duty));
+  }
+}
+
+static void testFilter() {
+  // First reading is taken as is and arms the guard
+  echoMm(0, 1000);
+  CHECK(obstacles.isValid(0));
+  CHECK(obstacles.isOnline(0));
+  CHECK(hasEvent("OBS:ONLINE:0"));
+  CHECK_NEAR(obstacles.getDistance(0), 1000, 0.5);
+
+  // A single spike is rejected by the median
+  echoMm(0, 1000);
+  echoMm(0, 3000);
+  CHECK_NEAR(obstacles.getDistance(0), 1000, 0.5);
+
+  // A real change passes once it is the median, then the EMA converges
+  echoMm(0, 500);
+  CHECK_NEAR(obstacles.getDistance(0), 1000, 0.5);
+  echoMm(0, 500);
+  CHECK_NEAR(obstacles.getDistance(0), 750, 0.5);
+  echoMm(0, 500);
+  CHECK_NEAR(obstacles.getDistance(0), 625, 0.5);
+
+  // No echo reads as out of range, the blind zone as its edge
+  for (int i = 0; i < 16; i++) echo(0, ULTRASONIC_ECHO_TIMEOUT_US);
+  CHECK_NEAR(obstacles.getDistance(0), ULTRASONIC_MAX_MM, 1.0);
+  for (int i = 0; i < 16; i++) echo(0, 10);
+  CHECK_NEAR(obstacles.getDistance(0), ULTRASONIC_MIN_MM, 1.0);
+}
+
+static void testFailClosed() {
+  for (int i = 0; i < 8; i++) echoMm(0, 2000);
+  events.clear();
+  CHECK(obstacles.isClear(DEFAULT_SPEED));
+
+  // Sensor goes quiet: faulted, forward refused and stopped
+  motors.forward(DEFAULT_SPEED);
+  CHECK(motors.isMoving());
+  for (int t = 0; t <= ULTRASONIC_STALE_MS; t += 10) {
+    host::advanceMillis(10);
+    obstacles.update(millis());
+  }
+  CHECK(!obstacles.isValid(0));
+  CHECK(hasEvent("OBS:FAULT:0"));
+  CHECK(!obstacles.isClear(DEFAULT_SPEED));
+  CHECK(motors.checkForwardGuard());
+  CHECK(!motors.isMoving());
+  obstacles.update(millis());
+  CHECK(hasEvent("OBS:BLOCKED:FAULT:0"));
+
+  // Driving one side forward is guarded the same way
+  motors.setLeftMotor(DIR_FORWARD, DEFAULT_SPEED);
+  CHECK(!motors.isMoving());
+
+  // Backing away is still allowed
+  motors.backward(DEFAULT_SPEED);
+  CHECK(motors.isMoving());
+  motors.stop();
+
+  // Readings again: clear
+  events.clear();
+  for (int i = 0; i < 3; i++) echoMm(0, 2000);
+  CHECK(hasEvent("OBS:CLEAR:2000"));
+  CHECK(obstacles.isClear(DEFAULT_SPEED));
+}
+
+static void testBlockedMoveNotTimed() {
+  for (int i = 0; i < 8; i++) echoMm(0, 100);
+  MotionPlan before = motion.plan(MOTION_LINEAR, 1000, 200);
+
+  // Neither a timed nor a physical forward move arms a timer that
+  // would later count as driven for K feedback
+  commands.process(String("F:200:500"));
+  CHECK(!motors.isMoving());
+  host::advanceMillis(600);
+  commands.update();
+  commands.process(String("K:400"));
+  CHECK_EQ(motion.plan(MOTION_LINEAR, 1000, 200).durationMs, before.durationMs);
+
+  commands.process(String("D:500:200"));
+  CHECK(!motors.isMoving());
+  host::advanceMillis(1000);
+  commands.update();
+  commands.process(String("K:400"));
+  CHECK_EQ(motion.plan(MOTION_LINEAR, 1000, 200).durationMs, before.durationMs);
+
+  // Reversing away from it is timed as usual
+  commands.process(String("D:-300:200"));
+  CHECK(motors.isMoving());
+  commands.process(String("S"));
+}
+
+int main() {
+  host::setMillis(1000);
+  motors.begin();
+  motion.begin();
+  motion.resetCalibration();
+  obstacles.addSensor(ULTRASONIC_TRIG_PIN, ULTRASONIC_ECHO_PIN);
+  obstacles.setEventCallback(onEvent);
+  motors.setForwardGuard(guard);
+
+  // Nothing heard since boot: no sensor fitted as far as the guard
+  // knows, so forward is allowed and nothing is faulted
+  CHECK(!obstacles.isOnline(0));
+  CHECK(obstacles.isClear(DEFAULT_SPEED));
+  host::advanceMillis(ULTRASONIC_STALE_MS * 2);
+  obstacles.update(millis());
+  CHECK(!hasEvent("OBS:FAULT:0"));
+  motors.setLeftMotor(DIR_FORWARD, DEFAULT_SPEED);
+  CHECK(motors.isMoving());
+  motors.stop();
+
+  testStoppingDistance();
+  testFilter();
+  testFailClosed();
+  testBlockedMoveNotTimed();
+  TEST_MAIN_END();
+}
@@ -0,0 +1,94 @@
+/*
+ * test_position_estimator.cpp
+ * Trilateration fix, odometry and interrupted-move odometry
+ */
+
+#include "test.h"
+#include "command_interface.h"
+
+#define TX_POWER   -59.0f
+#define PATH_LOSS  2.0f
+
+static const float BEACONS[3][2] = { { 0, 0 }, { 4000, 0 }, { 0, 4000 } };
+
+// Noise-free RSSI at a point, as an int for the P command
+static int rssiAt(float x, float y, int beacon) {
+  float range = hypotf(x - BEACONS[beacon][0], y - BEACONS[beacon][1]);
+  return (int)lroundf(TX_POWER - 10.0f * PATH_LOSS * log10f(range / 1000.0f));
+}
+
+static void testFixAndPredict() {
+  PositionEstimator position;
+  for (int b = 0; b < 3; b++) {
+    position.setBeacon(b + 1, BEACONS[b][0], BEACONS[b][1], TX_POWER, PATH_LOSS);
+  }
+  CHECK(!position.isValid());
+  position.updateRange(1, hypotf(1000, 2000), 100.0f);
+  position.updateRange(2, hypotf(3000, 2000), 100.0f);
+  CHECK(!position.isValid());                       // Needs three beacons
+  position.updateRange(3, hypotf(1000, 2000), 100.0f);
+  CHECK(position.isValid());
+  CHECK_NEAR(position.getX(), 1000, 1.0);
+  CHECK_NEAR(position.getY(), 2000, 1.0);
+
+  // Quarter turn left, then drive along +y
+  position.predict(0.0f, 0.5f * (float)M_PI);
+  position.predict(500.0f, 0.0f);
+  CHECK_NEAR(position.getX(), 1000, 1.0);
+  CHECK_NEAR(position.getY(), 2500, 1.0);
+  CHECK_NEAR(position.getHeading(), 0.5 * M_PI, 1e-4);
+}
+
+static void testInterruptedMoveOdometry() {
+  MotorControl motors;
+  MotionModel motion;
+  motion.begin();
+  motion.resetCalibration();
+  PositionEstimator position;
+  CommandInterface commands(&motors, &motion);
+  commands.setPositionEstimator(&position);
+
+  host::setMillis(0);
+  for (int b = 0; b < 3; b++) {
+    commands.process(String("A:") + String(b + 1) + ":" +
+                     String((int)BEACONS[b][0]) + ":" + String((int)BEACONS[b][1]));
+  }
+  for (int b = 0; b < 3; b++) {
+    commands.process(String("P:") + String(b + 1) + ":" + String(rssiAt(1000, 1000, b)));
+  }
+  CHECK(position.isValid());
+  float startX = position.getX();
+  float startY = position.getY();
+
+  // An arc cuts a 1 m drive short after 300 ms
+  commands.process(String("D:1000:200"));
+  host::advanceMillis(300);
+  commands.process(String("L"));
+
+  float driven = motion.displacement(MOTION_LINEAR, 200, 300);
+  CHECK(driven > 0);
+  CHECK_NEAR(position.getX() - startX, driven, 1.0);
+  CHECK_NEAR(position.getY() - startY, 0.0, 1.0);
+
+  // The arc itself is not modeled and adds no odometry
+  host::advanceMillis(500);
+  commands.process(String("S"));
+  CHECK_NEAR(position.getX() - startX, driven, 1.0);
+
+  // K feedback has nothing to refine after an arc
+  MotionPlan before = motion.plan(MOTION_LINEAR, 1000, 200);
+  commands.process(String("K:250"));
+  CHECK_EQ(motion.plan(MOTION_LINEAR, 1000, 200).durationMs, before.durationMs);
+
+  // Ranges and odometry are serialized by the command lock, which every
+  // path gives back
+  commands.process(String("W"));
+  commands.update();
+  CHECK_EQ(host::semaphoresHeld, 0);
+}
+
+int main() {
+  testFixAndPredict();
+  testInterruptedMoveOdometry();
+  TEST_MAIN_END();
+}
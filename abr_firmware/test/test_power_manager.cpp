@@ -0,0 +1,127 @@
+/*
+ * test_power_manager.cpp
+ * Idle state machine and energy accounting on a simulated clock
+ */
+
+#include "test.h"
+#include "power_manager.h"
+
+static MotorControl motors;
+static MotionModel motion;
+static CommandInterface commands(&motors, &motion);
+static BLEManager ble(&commands);
+
+// Run the loop at its tick interval for the given time
+static void run(PowerManager& power, unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while (millis() < end) {
+    host::advanceMillis(power.getTickInterval());
+    power.update(millis());
+  }
+}
+
+static void testEntersIdleAfterTimeout() {
+  host::setMillis(1000);
+  PowerManager power(&motors, &ble);
+  power.begin(millis());
+
+  run(power, DEFAULT_IDLE_TIMEOUT_MS - ACTIVE_TICK_MS);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+  CHECK_EQ(power.getTickInterval(), ACTIVE_TICK_MS);
+
+  run(power, 2 * ACTIVE_TICK_MS);
+  CHECK_EQ(power.getState(), POWER_IDLE);
+  CHECK(motors.isAsleep());
+  CHECK_EQ(power.getTickInterval(), IDLE_TICK_MS);
+  CHECK_EQ(power.getIdleEntries(), 1);
+
+  // Staying idle does not re-enter
+  run(power, 10000);
+  CHECK_EQ(power.getIdleEntries(), 1);
+}
+
+static void testActivityWakes() {
+  host::setMillis(0);
+  PowerManager power(&motors, &ble);
+  power.begin(millis());
+  run(power, DEFAULT_IDLE_TIMEOUT_MS + 100);
+  CHECK_EQ(power.getState(), POWER_IDLE);
+
+  // A BLE write or serial line wakes within one idle tick
+  power.notifyActivity(millis());
+  run(power, IDLE_TICK_MS);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+  CHECK(!motors.isAsleep());
+
+  // ...and restarts the idle timeout from the activity
+  run(power, DEFAULT_IDLE_TIMEOUT_MS - 100);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+  run(power, 200);
+  CHECK_EQ(power.getState(), POWER_IDLE);
+
+  // A motor command issued while idle re-attaches PWM and wakes
+  motors.forward(200);
+  run(power, IDLE_TICK_MS);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+  motors.stop();
+}
+
+static void testMovingNeverIdles() {
+  host::setMillis(0);
+  PowerManager power(&motors, &ble);
+  power.begin(millis());
+
+  motors.forward(200);
+  run(power, 3 * DEFAULT_IDLE_TIMEOUT_MS);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+
+  // Timeout counts from the stop, not from the last command
+  motors.stop();
+  run(power, DEFAULT_IDLE_TIMEOUT_MS - 100);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+  run(power, 200);
+  CHECK_EQ(power.getState(), POWER_IDLE);
+}
+
+static void testIdleDisabled() {
+  host::setMillis(0);
+  PowerManager power(&motors, &ble);
+  power.begin(millis());
+  power.setIdleTimeout(0);
+
+  run(power, 10 * DEFAULT_IDLE_TIMEOUT_MS);
+  CHECK_EQ(power.getState(), POWER_ACTIVE);
+  CHECK_EQ(power.getIdleEntries(), 0);
+}
+
+static void testEnergyAccounting() {
+  host::setMillis(0);
+  PowerManager power(&motors, &ble);
+  power.begin(millis());
+  power.setIdleTimeout(10000);
+
+  motors.forward(200);
+  run(power, 10000);
+  motors.stop();
+  run(power, 10000);          // Stopped until the timeout expires
+  run(power, 20000);          // Idle
+
+  CHECK_NEAR(power.getTimeInState(BUCKET_MOVING), 10000, ACTIVE_TICK_MS);
+  CHECK_NEAR(power.getTimeInState(BUCKET_STOPPED), 10000, 2 * ACTIVE_TICK_MS);
+  CHECK_NEAR(power.getTimeInState(BUCKET_IDLE), 20000, IDLE_TICK_MS);
+
+  // (900 mA * 10 s + 120 mA * 10 s + 25 mA * 20 s) * 7.4 V
+  double expected = (0.9 * 10 + 0.12 * 10 + 0.025 * 20) * 7.4 * 1000;
+  CHECK_NEAR(power.getEnergyMilliJoules(), expected, 200);
+
+  CHECK(power.getTelemetry() == "PWR:IDLE:10:10:20:79");
+}
+
+int main() {
+  testEntersIdleAfterTimeout();
+  testActivityWakes();
+  testMovingNeverIdles();
+  testIdleDisabled();
+  testEnergyAccounting();
+  TEST_MAIN_END();
+}
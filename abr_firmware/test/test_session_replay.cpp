@@ -0,0 +1,252 @@
+/*
+ * test_session_replay.cpp
+ * Capture formats, truncated inputs, firmware events and side-effect-free replay
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "test.h"
+#include "session_replay.h"
+#include <Preferences.h>
+
+static int notifications = 0;
+static int appCallbacks = 0;
+
+static void onNotify(BLECharacteristic*, const uint8_t*, size_t) { notifications++; }
+static void onAppCommand() { appCallbacks++; }
+
+static MotorControl motors;
+static MotionModel motion;
+static PositionEstimator position;
+static CommandInterface commands(&motors, &motion);
+static BLEManager ble(&commands);
+static SessionReplay replay(&motors, &motion, &commands, &ble);
+
+// Live input at the current time, as the loop and BLE task deliver it
+static void serialInput(const char* text) {
+  capture.recordInput(CAPTURE_SERIAL_INPUT, (const uint8_t*)text, strlen(text));
+  commands.process((const uint8_t*)text, strlen(text));
+  commands.clearResponse();
+}
+
+static void bleInput(const char* text) {
+  ble.handleControlWrite((const uint8_t*)text, strlen(text));
+}
+
+static bool obstacleAhead = false;
+static bool guard(uint8_t) { return !obstacleAhead; }
+
+static void runFor(unsigned long ms) {
+  for (unsigned long t = 0; t < ms; t += 10) {
+    host::advanceMillis(10);
+    commands.update();
+  }
+}
+
+static void testLoadFormat() {
+  capture.clear();
+  CHECK(capture.load(String("CAP 100 S 463A323030")));
+  CHECK(capture.load(String("CAP 200 B~ 4D3A")));
+  CHECK(!capture.load(String("CAP 50 S 46")));        // Out of order
+  CHECK(!capture.load(String("CAP 300 X 46")));       // Unknown type
+  CHECK_EQ(capture.count(), 2);
+  CHECK(!capture.at(0).truncated);
+  CHECK_EQ(capture.at(0).length, 5);
+  CHECK(capture.at(1).truncated);
+  CHECK_EQ(capture.at(1).length, 2);
+  capture.clear();
+
+  // Events carry exactly one cause byte
+  CHECK(capture.load(String("CAP 100 E 54")));
+  CHECK(!capture.load(String("CAP 200 E 5455")));
+  CHECK_EQ(capture.at(0).type, CAPTURE_EVENT);
+  CHECK_EQ(capture.at(0).data[0], CAPTURE_CAUSE_TIMEOUT);
+  capture.clear();
+
+  // Calibration lines set single fits, the rest keep their defaults
+  CHECK(!capture.hasCalibration());
+  CHECK(capture.load(String("CAP CAL 1 2 0.25 -12.5 3 1500 360 900000 200000 4")));
+  CHECK(!capture.load(String("CAP CAL 1 2 0.25 -12.5")));
+  CHECK(!capture.load(String("CAP CAL 2 0 0.25 0 0 0 0 0 0 0")));
+  CHECK_EQ(capture.count(), 0);
+  CHECK(capture.hasCalibration());
+  const MotionFit& fit = capture.getCalibration().fits[MOTION_ROTATION][2];
+  CHECK_NEAR(fit.rate, 0.25, 1e-6);
+  CHECK_NEAR(fit.offset, -12.5, 1e-6);
+  CHECK_NEAR(fit.sumTT, 900000, 1e-1);
+  CHECK_EQ(fit.samples, 4);
+  CHECK_NEAR(capture.getCalibration().fits[MOTION_LINEAR][0].rate,
+             MotionModel().getCalibration().fits[MOTION_LINEAR][0].rate, 1e-9);
+  capture.clear();
+  CHECK(!capture.hasCalibration());
+}
+
+static void testTruncation() {
+  char line[CAPTURE_PAYLOAD_MAX + 8];
+  memset(line, 'X', sizeof(line));
+  capture.start();
+  capture.recordInput(CAPTURE_SERIAL_INPUT, (const uint8_t*)line, CAPTURE_PAYLOAD_MAX);
+  capture.recordInput(CAPTURE_SERIAL_INPUT, (const uint8_t*)line, sizeof(line));
+  capture.stop();
+
+  CHECK_EQ(capture.count(), 2);
+  CHECK(!capture.at(0).truncated);
+  CHECK(capture.at(1).truncated);
+  CHECK_EQ(capture.at(1).length, CAPTURE_PAYLOAD_MAX);
+  capture.clear();
+}
+
+static void testWireFormat() {
+  capture.clear();
+  CHECK(capture.load(String("CAP 66051 S 463A")));
+  CHECK(capture.load(String("CAP 70000 B~ 4D")));
+
+  uint8_t wire[2 * CAPTURE_WIRE_SIZE + 8];
+  memset(wire, 0xAA, sizeof(wire));
+  CHECK_EQ(capture.byteSize(), 2 * CAPTURE_WIRE_SIZE);
+  CHECK_EQ(capture.readBytes(0, wire, sizeof(wire)), 2 * CAPTURE_WIRE_SIZE);
+  const uint8_t first[] = { 0x03, 0x02, 0x01, 0x00, 'S', 0, 2, 0, 'F', ':' };
+  CHECK(memcmp(wire, first, sizeof(first)) == 0);
+  for (size_t i = sizeof(first); i < CAPTURE_WIRE_SIZE; i++) CHECK_EQ(wire[i], 0);
+  CHECK_EQ(wire[CAPTURE_WIRE_SIZE + 5], CAPTURE_WIRE_TRUNCATED);
+
+  // Reads may start and end inside a record
+  uint8_t part[4];
+  CHECK_EQ(capture.readBytes(CAPTURE_WIRE_SIZE - 2, part, sizeof(part)), sizeof(part));
+  CHECK(memcmp(part, wire + CAPTURE_WIRE_SIZE - 2, sizeof(part)) == 0);
+  capture.clear();
+}
+
+static void testReplayLeavesNoTrace() {
+  host::setMillis(1000);
+  capture.start();
+  serialInput("V:150");
+  serialInput("F:180:300");
+  runFor(400);
+  bleInput("D:200");
+  runFor(400);
+  bleInput("T:90");
+  runFor(1200);
+  bleInput("K:120");                                  // Refines the model live
+  bleInput("?");
+  runFor(100);
+  char longLine[CAPTURE_PAYLOAD_MAX + 6];
+  memset(longLine, 'Z', sizeof(longLine) - 1);        // Invalid, and cut off
+  longLine[sizeof(longLine) - 1] = '\0';
+  serialInput(longLine);
+  serialInput("B:150:200");
+  runFor(300);
+  capture.stop();
+
+  // Live state after the session; the K feedback refined the model, the
+  // replay plans with the one saved at capture start
+  commands.process(String("V:200"));
+  commands.process(String("A:1:0:0"));
+  position.updateRange(1, 1000.0f, 100.0f);
+  MotionPlan livePlan = motion.plan(MOTION_ROTATION, 90, 150);
+  int nvsWrites = Preferences::writes;
+  uint32_t commandCount = metrics.getCounter(CTR_COMMANDS);
+  uint32_t bleWrites = metrics.getCounter(CTR_BLE_WRITES);
+  uint32_t invalid = metrics.getCounter(CTR_INVALID_COMMANDS);
+  int liveNotifications = notifications;
+  int liveCallbacks = appCallbacks;
+  float liveX = position.getX();
+  float liveY = position.getY();
+
+  CHECK(replay.run(capture));
+
+  CHECK(!motors.isDryRun());
+  CHECK(!motors.isMoving());
+  CHECK(commands.getStatus() == "STATUS:STOPPED:200");
+  MotionPlan plan = motion.plan(MOTION_ROTATION, 90, 150);
+  CHECK_EQ(plan.durationMs, livePlan.durationMs);
+  CHECK_EQ(Preferences::writes, nvsWrites);
+  CHECK_EQ(metrics.getCounter(CTR_COMMANDS), commandCount);
+  CHECK_EQ(metrics.getCounter(CTR_BLE_WRITES), bleWrites);
+  CHECK_EQ(metrics.getCounter(CTR_INVALID_COMMANDS), invalid);
+  CHECK_EQ(notifications, liveNotifications);
+  CHECK_EQ(appCallbacks, liveCallbacks);
+  CHECK_NEAR(position.getX(), liveX, 1e-3);
+  CHECK_NEAR(position.getY(), liveY, 1e-3);
+
+  // Position estimator is attached again
+  commands.process(String("W"));
+  CHECK(commands.hasResponse());
+  commands.clearResponse();
+
+  // BLE writes and the replay release the command lock
+  bleInput("?");
+  CHECK_EQ(host::semaphoresHeld, 0);
+}
+
+static void testFirmwareEvents() {
+  host::setMillis(50000);
+  obstacleAhead = false;
+  capture.start();
+  serialInput("F:200");
+  runFor(200);
+
+  // Obstacle stop, then a refused forward command
+  obstacleAhead = true;
+  CHECK(motors.checkForwardGuard());
+  runFor(100);
+  bleInput("F:210");
+  CHECK(!motors.isMoving());
+  bleInput("B:180");
+  runFor(300);
+
+  // Safety timeout as the loop applies it
+  obstacleAhead = false;
+  bleInput("F:190");
+  runFor(500);
+  capture.recordEvent(CAPTURE_CAUSE_TIMEOUT);
+  motors.stop();
+  runFor(1000);
+
+  // Idle sleep: a stop while asleep drives nothing, a move wakes up
+  motors.sleep();
+  runFor(100);
+  bleInput("S");
+  bleInput("G:150:200");
+  runFor(400);
+  capture.stop();
+
+  CHECK(replay.run(capture));
+  CHECK_EQ(host::semaphoresHeld, 0);
+  CHECK(!motors.isAsleep());
+  CHECK(motors.getForwardGuard() == guard);
+
+  // Without the events the outputs cannot be reproduced
+  static SessionCapture stripped;
+  for (size_t i = 0; i < capture.count(); i++) {
+    const CaptureRecord& record = capture.at(i);
+    if (record.type == CAPTURE_EVENT) continue;
+    char line[CAPTURE_PAYLOAD_MAX * 2 + 32];
+    int n = snprintf(line, sizeof(line), CAPTURE_LINE_PREFIX "%lu %c ",
+                     (unsigned long)record.timeUs, record.type);
+    for (uint8_t b = 0; b < record.length; b++) {
+      n += snprintf(line + n, sizeof(line) - n, "%02X", record.data[b]);
+    }
+    CHECK(stripped.load(String(line)));
+  }
+  CHECK(!replay.run(stripped));
+}
+
+int main() {
+  motors.begin();
+  motors.setOutputObserver(SessionCapture::recordOutput);
+  motion.begin();
+  capture.setMotionModel(&motion);
+  motors.setForwardGuard(guard);
+  commands.setPositionEstimator(&position);
+  ble.begin();
+  ble.setCommandReceivedCallback(onAppCommand);
+  BLECharacteristic::notifyHook = onNotify;
+
+  testLoadFormat();
+  testTruncation();
+  testWireFormat();
+  testReplayLeavesNoTrace();
+  testFirmwareEvents();
+  TEST_MAIN_END();
+}